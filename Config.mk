@@ -0,0 +1,34 @@
+name		:= cwiclo
+
+################ Programs ############################################
+
+CXX		:= g++
+CC		:= gcc
+AR		:= ar
+RANLIB		:= ranlib
+INSTALL		:= install
+INSTALL_DATA	:= ${INSTALL} -m 644
+
+################ Destination #########################################
+
+prefix		:= /usr/local
+includedir	:= ${prefix}/include
+libdir		:= ${prefix}/lib
+pkgconfigdir	:= ${libdir}/pkgconfig
+TMPDIR		:= /tmp
+builddir	:= ${TMPDIR}/make/${name}
+O		:= .o/
+
+################ Compiler options ####################################
+
+#debug		:= 1
+ifdef debug
+    cxxflags	:= -O0 -ggdb3
+    ldflags	:= -g -rdynamic ${LDFLAGS}
+else
+    cxxflags	:= -Os -g0 -DNDEBUG=1
+    ldflags	:= -s -Wl,-O1,-gc-sections ${LDFLAGS}
+endif
+CXXFLAGS	:= -Wall -Wextra -Wredundant-decls -Wshadow
+cxxflags	+= -std=c++20 -fno-exceptions -fno-rtti \
+		   -ffunction-sections -fdata-sections ${CXXFLAGS}
@@ -14,7 +14,7 @@ class Extern;
 class App : public AppL {
     IMPLEMENT_INTERFACES_I (AppL,,(ITimer))
 public:
-    enum { f_SocketActivated = base_class_t::f_Last, f_ListenWhenEmpty, f_Last };
+    enum { f_SocketActivated = base_class_t::f_Last, f_ListenWhenEmpty, f_ExternRings, f_Last };
 public:
     static auto&	instance (void)	{ return static_cast<App&>(base_class_t::instance()); }
     static auto		imports (void)	{ return s_imports; }
@@ -25,6 +25,8 @@ public:
     iid_t		extern_interface_by_name (const char* is, size_t islen) const;
     Extern*		extern_by_id (mrid_t eid) const;
     Extern*		create_extern_dest_for (iid_t iid);
+    constexpr auto	extern_rings (void) const	{ return flag (f_ExternRings); }
+    constexpr void	set_extern_rings (bool v = true) { set_flag (f_ExternRings, v); }
 protected:
     //{{{ IListener
     class IListener : public ITimer {
@@ -6,12 +6,24 @@
 #include "appl.h"
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/eventfd.h>
+#if USE_EPOLL
+    #include <sys/epoll.h>
+    #if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35)
+	#define USE_EPOLL_PWAIT2 1
+    #endif
+#endif
+#if USE_URING
+    #include <linux/io_uring.h>
+#endif
 
 //{{{ Timer and Signal interfaces --------------------------------------
 namespace cwiclo {
 
 void ITimer::watch (WatchCmd cmd, fd_t fd, mstime_t timeoutms) const
     { send (m_watch(), cmd, fd, timeoutms); }
+void ITimer::watch_until (WatchCmd cmd, fd_t fd, nstime_t deadline) const
+    { send (m_watch_until(), cmd, fd, deadline); }
 
 //----------------------------------------------------------------------
 
@@ -20,12 +32,40 @@ AppL::Timer::~Timer (void)
 
 void AppL::Timer::Timer_watch (ITimer::WatchCmd cmd, fd_t fd, mstime_t timeoutms)
 {
+    nstime_t deadline = ITimer::TimerNone;
+    if (timeoutms <= ITimer::TimerMax)	// clamped to fit the ns deadline
+	deadline = min (timeoutms, ITimer::TimerMax/1000000) * 1000000 + ITimer::now();
+    Timer_watch_until (cmd, fd, deadline);
+}
+
+void AppL::Timer::Timer_watch_until (ITimer::WatchCmd cmd, fd_t fd, nstime_t deadline)
+{
+    // Watch requests queued by a since destroyed creator are ignored,
+    // or they would keep the orphaned Timer alive. With io_uring, its
+    // pending poll request would also keep the closed fd open.
+    if (creator_id() == msger_id())
+	cmd = ITimer::WatchCmd::Stop;
+    auto& app = AppL::instance();
+    auto oldfd = watches_fd() ? _fd : -1;
+    app.unlink_fd_timer (this);
+    app.unschedule_timer (this);
     _cmd = cmd;
     set_unused (_cmd == ITimer::WatchCmd::Stop);
     _fd = fd;
-    _nextfire = timeoutms + (timeoutms <= ITimer::TimerMax ? chrono::system_clock::now() : ITimer::TimerNone);
+    _nextfire = deadline;
+    if (_cmd != ITimer::WatchCmd::Stop && _nextfire != ITimer::TimerNone)
+	app.schedule_timer (this);
+    app.link_fd_timer (this);
+    // A Timer newly joining an fd forces reregistration, since the
+    // previous watcher may have let it be closed and reused.
+    if (oldfd != _fd)
+	app.update_fd_watch (oldfd);
+    app.update_fd_watch (_fd, oldfd != _fd);
 }
 
+void AppL::Timer::stop (void)
+    { Timer_watch (ITimer::WatchCmd::Stop, -1, ITimer::TimerNone); }
+
 IMPLEMENT_INTERFACES_D (AppL::Timer)
 
 //}}}-------------------------------------------------------------------
@@ -34,6 +74,7 @@ IMPLEMENT_INTERFACES_D (AppL::Timer)
 AppL*	AppL::s_pApp		= nullptr;	// static
 int	AppL::s_exit_code	= EXIT_SUCCESS;	// static
 uint32_t AppL::s_received_signals = 0;		// static
+AppL::fd_t AppL::s_sigwakefd = -1;		// static
 
 //----------------------------------------------------------------------
 
@@ -43,12 +84,50 @@ AppL::AppL (void)
 ,_inq()
 ,_msgers()
 ,_timers()
+,_timerq()
 ,_creators()
+,_mridlinks()
+,_subscribers()
+,_newmsgers()
+,_unusedmsgers()
+,_bodyarena()
+,_bodyarenasize (0)
+,_bodypool()
+,_bodypoolsize (BodyPool::DefaultSize)
+,_noutq()
+,_inboxlimits()
+,_grouplast()
+,_grouphead()
+,_grouplinks()
+,_groupbuf()
+,_backlogwaits()
+,_stats()
+,_outqidx()
+,_outqgen (1)
+,_freemrids()
+,_freemridwords()
+,_fdwatch()
+,_nfdtimers (0)
+,_timerslack (0)
+,_epfd (-1)
+,_postfd (-1)
+,_posted()
+,_uring()
+,_trace()
 ,_errors()
 {
     assert (!s_pApp && "there must be only one App object");
     s_pApp = this;
     register_singleton_msger (this);
+    [[maybe_unused]] bool haveuring = false;
+    #if USE_URING
+	haveuring = _uring.open();	// epoll is used if io_uring is unavailable
+    #endif
+    #if USE_EPOLL
+	if (!haveuring)
+	    _epfd = epoll_create1 (EPOLL_CLOEXEC);	// ppoll is used if this fails
+    #endif
+    watch_signal_wake();
 }
 
 AppL::~AppL (void)
@@ -56,6 +135,20 @@ AppL::~AppL (void)
     // Delete Msgers in reverse order of creation
     for (mrid_t mid = _msgers.size(); mid--;)
 	delete_msger (mid);
+    #if USE_URING
+	// Pending io_uring poll requests hold references to their files,
+	// keeping closed sockets open. Submit the removals queued by
+	// the deleted Msgers to release them before exit.
+	if (_uring.is_open())
+	    _uring.submit_and_wait (0);
+    #endif
+    if (_epfd >= 0)
+	close (exchange (_epfd, -1));
+    if (_postfd >= 0)
+	close (exchange (_postfd, -1));
+    for (auto p = _posted; p;)	// posted after the loop exited
+	delete exchange (p, p->next);
+    trim_body_pool (0);
     if (!_errors.empty())
 	fprintf (stderr, "Error: %s\n", _errors.c_str());
 }
@@ -74,6 +167,11 @@ enum { qc_ShellSignalQuitOffset = 128 };
 
 void AppL::install_signal_handlers (void) // static
 {
+    // Signals wake the message loop through this eventfd, so that it
+    // does not have to block them outside the wait. If it can not be
+    // created, they are blocked, and unblocked by the wait syscall.
+    if (s_sigwakefd < 0)
+	s_sigwakefd = eventfd (0, EFD_NONBLOCK| EFD_CLOEXEC);
     for (auto sig = 0u; sig < NSIG; ++sig) {
 	if (get_bit (sigset_Msg, sig))
 	    signal (sig, msg_signal_handler);
@@ -98,7 +196,14 @@ void AppL::fatal_signal_handler (int sig) // static
 
 void AppL::msg_signal_handler (int sig) // static
 {
-    set_bit (s_received_signals, sig);
+    // Signals are not blocked while the loop reads and clears the bits
+    __atomic_fetch_or (&s_received_signals, 1u<<sig, int(memory_order::release));
+    if (s_sigwakefd >= 0) {	// after setting the bit, to be seen when woken
+	auto e = errno;
+	uint64_t one = 1;
+	[[maybe_unused]] auto r = write (s_sigwakefd, &one, sizeof(one));
+	errno = e;
+    }
     if (get_bit (sigset_Quit, sig)) {
 	AppL::instance().quit();
 	if (!debug_tracing_on())
@@ -125,12 +230,30 @@ bool AppL::forward_error (mrid_t oid, mrid_t eoid)
 //}}}-------------------------------------------------------------------
 //{{{ Msger lifecycle
 
+void AppL::update_free_mrid (mrid_t id)
+{
+    // An mrid is free when released by its creator and without a Msger
+    auto isfree = id < _creators.size() && _creators[id] == id && !_msgers[id];
+    auto wi = id / bits_in_type<uint64_t>::value;
+    set_bit (_freemrids[wi], id % bits_in_type<uint64_t>::value, isfree);
+    set_bit (_freemridwords[wi / bits_in_type<uint64_t>::value], wi % bits_in_type<uint64_t>::value, _freemrids[wi]);
+}
+
+mrid_t AppL::first_free_mrid (void) const
+{
+    // The lowest free mrid is reused first, as before
+    for (auto w = 0u; w < size(_freemridwords); ++w) {
+	if (!_freemridwords[w])
+	    continue;
+	auto wi = w*bits_in_type<uint64_t>::value + __builtin_ctzll (_freemridwords[w]);
+	return wi*bits_in_type<uint64_t>::value + __builtin_ctzll (_freemrids[wi]);
+    }
+    return _creators.size();
+}
+
 mrid_t AppL::allocate_mrid (mrid_t creator)
 {
-    mrid_t id = 0;
-    for (; id < _creators.size(); ++id)
-	if (_creators[id] == id && !_msgers[id])
-	    break;
+    mrid_t id = first_free_mrid();
     if (id > mrid_Last) {
 	assert (id <= mrid_Last && "mrid_t address space exhausted; please ensure somebody is freeing them");
 	error ("no more mrids");
@@ -139,13 +262,44 @@ mrid_t AppL::allocate_mrid (mrid_t creator)
 	assert (valid_msger_id (creator) || creator == id);
 	_msgers.push_back (nullptr);
 	_creators.push_back (creator);
+	if (_mridlinks.size() <= id)
+	    _mridlinks.push_back (MridLinks { mrid_None, mrid_None, mrid_None });
     } else {
 	assert (valid_msger_id (creator));
 	_creators[id] = creator;
     }
+    link_child_mrid (id);
+    update_free_mrid (id);
     return id;
 }
 
+void AppL::link_child_mrid (mrid_t id)
+{
+    // Children are prepended, to be freed in reverse order of creation
+    auto crid = _creators[id];
+    if (crid == id)
+	return;	// released mrids and the App have no creator
+    auto& l = _mridlinks[id];
+    l.prevsib = mrid_None;
+    l.nextsib = exchange (_mridlinks[crid].firstchild, id);
+    if (l.nextsib != mrid_None)
+	_mridlinks[l.nextsib].prevsib = id;
+}
+
+void AppL::unlink_child_mrid (mrid_t id)
+{
+    auto crid = _creators[id];
+    if (crid == id)
+	return;
+    auto& l = _mridlinks[id];
+    if (l.prevsib != mrid_None)
+	_mridlinks[l.prevsib].nextsib = l.nextsib;
+    else
+	_mridlinks[crid].firstchild = l.nextsib;
+    if (l.nextsib != mrid_None)
+	_mridlinks[l.nextsib].prevsib = l.prevsib;
+}
+
 void AppL::free_mrid (mrid_t id)
 {
     if (!valid_msger_id (id))
@@ -153,11 +307,15 @@ void AppL::free_mrid (mrid_t id)
     auto m = _msgers[id];
     if (!m && id == _msgers.size()-1) {
 	debug_printf ("[M] mrid %hu deallocated\n", id);
+	unlink_child_mrid (id);
 	_msgers.pop_back();
 	_creators.pop_back();
+	update_free_mrid (id);
     } else if (auto crid = _creators[id]; crid != id) {
 	debug_printf ("[M] mrid %hu released\n", id);
+	unlink_child_mrid (id);
 	_creators[id] = id;
+	update_free_mrid (id);
 	if (m) { // act as if the creator was destroyed
 	    assert (m->creator_id() == crid);
 	    m->on_msger_destroyed (crid);
@@ -170,6 +328,9 @@ mrid_t AppL::register_singleton_msger (Msger* m)
     auto id = allocate_mrid (mrid_App);
     if (id <= mrid_Last) {
 	_msgers[id] = m;
+	_newmsgers.push_back (id);	// not constructed yet, so subscribed later
+	update_free_mrid (id);
+	++_stats.c.created;
 	debug_printf ("[M] Created Msger %hu singleton\n", id);
     }
     return id;
@@ -206,9 +367,12 @@ void AppL::create_method_dest (methodid_t mid, Msg::Link l)
 {
     assert (valid_msger_id (l.src) && "You may only create links originating from an existing Msger");
     if (l.dest < _msgers.size() && !_msgers[l.dest]) {
-	if (_creators[l.dest] == l.src)
+	if (_creators[l.dest] == l.src) {
 	    _msgers[l.dest] = create_msger (l, interface_of_method(mid));
-	else // messages for a deleted Msger can arrive if the sender was not yet aware of the deletion, in another process, for example, where the notification had not arrived. Condition logged, but is not usually an error.
+	    _newmsgers.push_back (l.dest);
+	    update_free_mrid (l.dest);
+	    _stats.c.created += !!_msgers[l.dest];
+	} else // messages for a deleted Msger can arrive if the sender was not yet aware of the deletion, in another process, for example, where the notification had not arrived. Condition logged, but is not usually an error.
 	    debug_printf ("Warning: dead destination Msger %hu can only be resurrected by creator %hu, not %hu.\n", l.dest, _creators[l.dest], l.src);
     }
 }
@@ -216,24 +380,36 @@ void AppL::create_method_dest (methodid_t mid, Msg::Link l)
 void AppL::create_dest_with (iid_t iid, Msger::pfn_factory_t fac, Msg::Link l)
 {
     assert (valid_msger_id (l.src) && "You may only create links originating from an existing Msger");
-    if (l.dest < _msgers.size() && !_msgers[l.dest])
+    if (l.dest < _msgers.size() && !_msgers[l.dest]) {
 	_msgers[l.dest] = create_msger_with (l, iid, fac);
+	_newmsgers.push_back (l.dest);
+	update_free_mrid (l.dest);
+	_stats.c.created += !!_msgers[l.dest];
+    }
 }
 
 void AppL::delete_msger (mrid_t mid)
 {
     assert (valid_msger_id(mid) && valid_msger_id(_creators[mid]));
     auto m = exchange (_msgers[mid], nullptr);
+    update_free_mrid (mid);
+    _stats.c.deleted += !!m;
+    unsubscribe_msger (mid);
+    if (mid < _inboxlimits.size())	// the mrid may be reused
+	_inboxlimits[mid] = 0;
+    for (auto i = _backlogwaits.size(); i--;)	// deleted Msgers are not notified
+	if (_backlogwaits[i].src == mid)
+	    _backlogwaits.erase (_backlogwaits.iat(i));
     auto crid = _creators[mid];
     if (m && !m->flag (f_Static)) {
 	delete m;
 	debug_printf ("[M] Msger %hu deleted\n", mid);
     }
 
-    // Notify Msgers created by this one of its destruction
-    for (auto i = _creators.size(); i--;)
-	if (_creators[i] == mid)
-	    free_mrid (i);
+    // Notify Msgers created by this one of its destruction.
+    // free_mrid unlinks each from the list.
+    for (mrid_t c; (c = _mridlinks[mid].firstchild) != mrid_None;)
+	free_mrid (c);
 
     // Notify creator, if it exists
     if (crid < _msgers.size() && _msgers[crid])
@@ -244,10 +420,20 @@ void AppL::delete_msger (mrid_t mid)
 
 void AppL::delete_unused_msgers (void)
 {
-    // A Msger is unused if it has f_Unused flag set and has no pending messages in _outq
-    for (auto m : _msgers)
-	if (m && m->flag (f_Unused) && !has_messages_for (m->msger_id()))
-	    delete_msger (m->msger_id());
+    // A Msger is unused if it has f_Unused flag set and has no pending messages in _outq.
+    // Only the flagged Msgers are checked; those with messages are kept for later.
+    // Deleting may flag more, appending them to the list, so it is indexed.
+    auto o = 0u;
+    for (auto i = 0u; i < _unusedmsgers.size(); ++i) {
+	auto mid = _unusedmsgers[i];
+	if (auto m = msger_by_id (mid); !m || !m->flag (f_Unused))
+	    continue;	// already deleted, or no longer unused
+	else if (has_messages_for (mid))
+	    _unusedmsgers[o++] = mid;
+	else
+	    delete_msger (mid);
+    }
+    _unusedmsgers.erase (_unusedmsgers.begin()+o, _unusedmsgers.end());
 }
 
 //}}}-------------------------------------------------------------------
@@ -266,59 +452,485 @@ int AppL::run (void)
 
 void AppL::message_loop_once (void)
 {
-    _inq.clear();	// input queue was processed on the last iteration
-    _inq.swap (_outq);	// output queue now becomes the input queue
+    recycle_inq_bodies();
+    for (auto lane = 0u; lane < NPriorities; ++lane) {
+	_inq[lane].clear();	// input queue was processed on the last iteration
+	_inq[lane].swap (_outq[lane]);	// output queue now becomes the input queue
+    }
+    reset_body_arena();	// and so do their body arenas
+    uint64_t depth = 0;
+    for (auto& q : _inq) {	// and its messages are no longer pending
+	depth += q.size();
+	for (auto& msg : q)
+	    if (msg.dest() <= mrid_Last)
+		--_noutq[msg.dest()];
+    }
+    clear_outq_index();
+    if (__atomic_load_n (&_posted, int(memory_order::relaxed)))
+	drain_posted();
 
+    auto busystart = ITimer::now();
     process_input_queue();
+    count_iteration (depth, ITimer::now() - busystart);
+    if (!_backlogwaits.empty())
+	notify_drained();
     delete_unused_msgers();
 }
 
 void AppL::process_input_queue (void)
 {
-    for (auto& msg : _inq) {
-	// Dump the message if tracing
-	if (debug_tracing_on()) {
-	    debug_printf ("Msg: %hu -> %hu.%s.%s [%u] = {""{{\n", msg.src(), msg.dest(), msg.interface(), msg.method(), msg.size());
-	    hexdump (msg.read());
-	    debug_printf ("}""}}\n");
+    // Usually all messages are in one lane, and are dispatched in order
+    auto nlanes = 0u, lane = 0u;
+    for (auto l = 0u; l < NPriorities; ++l) {
+	if (_inq[l].empty())
+	    continue;
+	++nlanes, lane = l;
+	if (batch_dispatch())
+	    group_by_dest (_inq[l]);
+    }
+    if (nlanes <= 1) {
+	for (msgq_t::size_type i = 0; i < _inq[lane].size();)
+	    if (!dispatch_inq_run (_inq[lane], i))
+		return quit (EXIT_FAILURE);
+	return;
+    }
+
+    // Otherwise, the highest lane with messages goes first, unless a
+    // lower lane has waited through LaneBurst messages from above it.
+    msgq_t::size_type next [NPriorities] = {};
+    unsigned waited [NPriorities] = {};
+    for (;;) {
+	lane = NPriorities;
+	for (unsigned l = NPriorities; l--;) {
+	    if (next[l] >= _inq[l].size())
+		continue;
+	    if (lane == NPriorities)
+		lane = l;
+	    else if (waited[l] >= LaneBurst) {
+		lane = l;
+		break;
+	    }
 	}
+	if (lane == NPriorities)
+	    return;	// all lanes done
+	auto first = next[lane];
+	if (!dispatch_inq_run (_inq[lane], next[lane]))
+	    return quit (EXIT_FAILURE);
+	waited[lane] = 0;
+	for (auto l = 0u; l < lane; ++l)
+	    waited[l] += next[lane] - first;
+    }
+}
+
+// Dispatches message i and, in batch mode, the rest with the same
+// destination following it. Returns false on unhandled error.
+bool AppL::dispatch_inq_run (msgq_t& q, msgq_t::size_type& i)
+{
+    auto& msg = q[i++];
+    auto mg = msg.dest();
+    if (!batch_dispatch() || !valid_msger_id (mg))	// including broadcasts
+	return dispatch_inq_msg (msg);
+    while (i < q.size() && q[i].dest() == mg)
+	++i;
+    auto f = &msg, l = q.begin()+i;
+    for (auto m = f; m < l; ++m) {
+	count_dispatch (m->method());
+	if (_trace.is_open())
+	    _trace.record (*m);
+	if (debug_tracing_on())
+	    trace_inq_msg (*m);
+    }
+    return dispatch_batch_to (mg, f, l);
+}
+
+void AppL::trace_inq_msg (const Msg& msg) const
+{
+    debug_printf ("Msg: %hu -> %hu.%s.%s [%u] = {""{{\n", msg.src(), msg.dest(), msg.interface(), msg.method(), msg.size());
+    hexdump (msg.read());
+    debug_printf ("}""}}\n");
+}
+
+// Returns false if dispatch generated an unhandled error
+bool AppL::dispatch_inq_msg (Msg& msg)
+{
+    count_dispatch (msg.method());
+
+    // Record or dump the message if tracing
+    if (_trace.is_open())
+	_trace.record (msg);
+    if (debug_tracing_on())
+	trace_inq_msg (msg);
+
+    // Broadcast messages go to all subscribers, the rest go to one.
+    if (msg.dest() == mrid_Broadcast)
+	return dispatch_broadcast (msg);
+    if (!valid_msger_id (msg.dest())) {
+	debug_printf ("[E] Invalid message destination %hu. Ignoring message.\n", msg.dest()); // Error was reported in allocate_mrid
+	return true;
+    }
+    return dispatch_to (msg.dest(), msg);
+}
+
+// Returns false if dispatch generated an unhandled error
+bool AppL::dispatch_to (mrid_t mg, Msg& msg)
+{
+    auto msger = _msgers[mg];
+    if (!msger)
+	return true; // errors for msger creation failures were reported in create_msger; here just try to continue
 
-	// Create the dispatch range. Broadcast messages go to all, the rest go to one.
-	auto mg = 0u, mgend = _msgers.size();
-	if (msg.dest() != mrid_Broadcast) {
-	    if (!valid_msger_id (msg.dest())) {
-		debug_printf ("[E] Invalid message destination %hu. Ignoring message.\n", msg.dest());
-		continue; // Error was reported in allocate_mrid
+    auto accepted = msger->dispatch (msg);
+
+    if (!accepted && msg.dest() != mrid_Broadcast)
+	debug_printf ("[E] Message delivered, but not accepted by the destination Msger.\nDid you forget to add the interface to IMPLEMENT_INTERFACES?\n");
+
+    // Check for errors generated during this dispatch
+    return errors().empty() || forward_error (mg, mg);
+}
+
+// Returns false if dispatch generated an unhandled error
+bool AppL::dispatch_batch_to (mrid_t mg, Msg* f, Msg* l)
+{
+    auto msger = _msgers[mg];
+    if (!msger)
+	return true;
+    if (!msger->dispatch_batch (f, l))
+	debug_printf ("[E] Message delivered, but not accepted by the destination Msger.\nDid you forget to add the interface to IMPLEMENT_INTERFACES?\n");
+    return errors().empty() || forward_error (mg, mg);
+}
+
+// Groups messages by destination, so that each Msger gets its messages
+// together. Broadcasts stay in place, and only the runs of unicasts
+// between them are grouped.
+void AppL::group_by_dest (msgq_t& q)
+{
+    for (msgq_t::size_type f = 0, l; f < q.size(); f = l+1) {
+	for (l = f; l < q.size() && q[l].dest() <= mrid_Last; ++l) {}
+	if (l - f > 2)
+	    group_run_by_dest (q, f, l);
+    }
+}
+
+// Moves the messages in [f,l) for each destination up to the first one,
+// in order of first message, as far as their senders' order allows. A
+// message is moved ahead only when the previous one from its sender has
+// already been placed, so the order is preserved for each sender. Like
+// in vector, messages are relocated bitwise.
+void AppL::group_run_by_dest (msgq_t& q, uint32_t f, uint32_t l)
+{
+    auto n = l - f;
+    _grouplinks.resize (n);
+    // Link each message to the previous one from its sender
+    for (auto i = 0u; i < n; ++i) {
+	auto s = q[f+i].src();
+	if (_grouplast.size() <= s)
+	    _grouplast.resize (s+1, GroupLink::None);
+	_grouplinks[i].prevsrc = exchange (_grouplast[s], i);
+	_grouplinks[i].placed = false;
+    }
+    // And to the next one for its destination, counting destinations
+    auto ndests = 0u, nchanges = 0u;
+    for (auto i = n; i--;) {
+	auto d = q[f+i].dest();
+	if (_grouphead.size() <= d)
+	    _grouphead.resize (d+1, GroupLink::None);
+	ndests += _grouphead[d] == GroupLink::None;
+	nchanges += i && d != q[f+i-1].dest();
+	_grouplinks[i].nextdest = exchange (_grouphead[d], i);
+    }
+    // Unless already grouped, place each destination's messages
+    // starting from the first message not yet placed.
+    if (nchanges >= ndests) {
+	_groupbuf.reserve (n*sizeof(Msg));
+	auto gq = pointer_cast<char>(_groupbuf.data());
+	auto o = 0u;
+	for (auto c = 0u; c < n; ++c) {
+	    if (_grouplinks[c].placed)
+		continue;
+	    // c is the head of its destination, and its sender's
+	    // previous message, being before it, is placed.
+	    for (auto& h = _grouphead[q[f+c].dest()]; h != GroupLink::None; h = _grouplinks[h].nextdest) {
+		auto& hl = _grouplinks[h];
+		if (hl.prevsrc != GroupLink::None && !_grouplinks[hl.prevsrc].placed)
+		    break;
+		hl.placed = true;
+		copy_n (pointer_cast<char>(&q[f+h]), sizeof(Msg), gq + o++*sizeof(Msg));
 	    }
-	    mg = msg.dest();
-	    mgend = mg+1;
 	}
-	for (; mg < mgend; ++mg) {
-	    auto msger = _msgers[mg];
-	    if (!msger)
-		continue; // errors for msger creation failures were reported in create_msger; here just try to continue
+	copy_n (gq, n*sizeof(Msg), pointer_cast<char>(&q[f]));
+    }
+    for (auto i = f; i < l; ++i) {
+	_grouplast[q[i].src()] = GroupLink::None;
+	_grouphead[q[i].dest()] = GroupLink::None;
+    }
+}
+
+void AppL::reset_body_arena (void)
+{
+    // The arena of the cleared _inq becomes the _outq arena
+    swap (_bodyarena[0], _bodyarena[1]);
+    auto& a = _bodyarena[0];
+    a.used = 0;
+    // Resizing is safe here, with nothing linked to it
+    if (a.mem.capacity() < _bodyarenasize || (!_bodyarenasize && a.mem.capacity())) {
+	a.mem.deallocate();
+	if (_bodyarenasize)
+	    a.mem.reserve (_bodyarenasize);
+    }
+}
+
+void AppL::recycle_inq_bodies (void)
+{
+    if (_bodypool.pooled > _bodypoolsize)
+	trim_body_pool (_bodypoolsize);
+    for (auto& q : _inq) {
+	for (auto& msg : q) {
+	    // Inline and arena bodies, and those moved out, have no capacity
+	    auto cap = msg.body_capacity();
+	    if (cap < (1u << BodyPool::MinClass))
+		continue;
+	    auto c = log2p1 (cap) - 1 - BodyPool::MinClass;	// largest class it fills
+	    cap = 1u << (c + BodyPool::MinClass);
+	    if (c >= BodyPool::NClasses || _bodypool.pooled + cap > _bodypoolsize)
+		continue;
+	    auto b = msg.move_body();
+	    auto p = b.data();
+	    b.unlink();	// now owned by the pool
+	    *pointer_cast<Msg::Body::pointer>(p) = exchange (_bodypool.free[c], p);
+	    _bodypool.pooled += cap;
+	}
+    }
+}
 
-	    auto accepted = msger->dispatch (msg);
+// Frees pooled bodies, largest first, until at most sz bytes remain
+void AppL::trim_body_pool (streamsize sz)
+{
+    for (streamsize c = BodyPool::NClasses; c-- && _bodypool.pooled > sz;) {
+	for (auto& f = _bodypool.free[c]; f && _bodypool.pooled > sz;) {
+	    free (exchange (f, *pointer_cast<Msg::Body::pointer>(f)));
+	    _bodypool.pooled -= streamsize(1) << (c + BodyPool::MinClass);
+	}
+    }
+}
 
-	    if (!accepted && msg.dest() != mrid_Broadcast)
-		debug_printf ("[E] Message delivered, but not accepted by the destination Msger.\nDid you forget to add the interface to IMPLEMENT_INTERFACES?\n");
+//}}}-------------------------------------------------------------------
+//{{{ Backpressure
 
-	    // Check for errors generated during this dispatch
-	    if (!errors().empty() && !forward_error (mg, mg))
-		return quit (EXIT_FAILURE);
+// Limits the number of messages queued for mid in one iteration.
+// Senders checking IDispatch::dest_backlogged can then pause.
+void AppL::set_inbox_limit (mrid_t mid, uint32_t n)
+{
+    if (_inboxlimits.size() <= mid)
+	_inboxlimits.resize (mid+1);
+    _inboxlimits[mid] = n;
+}
+
+bool AppL::is_inbox_full (mrid_t mid) const
+{
+    if (auto lim = inbox_limit (mid); lim && has_messages_for (mid) >= lim)
+	return true;
+    auto m = msger_by_id (mid);	// a Msger may be backlogged elsewhere, like in a socket
+    return m && m->is_backlogged();
+}
+
+// Returns true if l.dest can not take more messages, and then
+// calls on_dest_drained for l.src when it can.
+bool AppL::is_backlogged (Msg::Link l)
+{
+    if (!is_inbox_full (l.dest))
+	return false;
+    if (!find (_backlogwaits, l))
+	_backlogwaits.push_back (l);
+    return true;
+}
+
+void AppL::notify_drained (void)
+{
+    // Notified senders may fill the dest and wait again, appending
+    for (auto i = 0u; i < _backlogwaits.size();) {
+	auto l = _backlogwaits[i];
+	if (is_inbox_full (l.dest)) {
+	    ++i;
+	    continue;
 	}
+	_backlogwaits.erase (_backlogwaits.iat(i));
+	if (auto m = msger_by_id (l.src); m)
+	    m->on_dest_drained (l.dest);
     }
 }
 
+//}}}-------------------------------------------------------------------
+//{{{ Loop statistics
+
+static inline auto method_stat_hash (methodid_t mid)
+    { return uintptr_t(mid) * UINT64_C(0x9e3779b97f4a7c15); }
+
+static inline auto histogram_bin (uint64_t v)
+    { return min (log2p1 (v), unsigned(IStats::NHistBins-1)); }
+
+void AppL::count_dispatch (methodid_t mid)
+{
+    if (_stats.methods.size() <= 2*_stats.nmethods)
+	grow_method_stats();
+    ++_stats.c.dispatched;
+    auto mask = _stats.methods.size()-1;
+    for (auto i = method_stat_hash (mid) >> (64-log2p1(mask)); ; i = (i+1) & mask) {
+	auto& s = _stats.methods[i];
+	if (s.method == mid) {
+	    ++s.n;
+	    return;
+	} else if (!s.method) {
+	    s.method = mid;
+	    s.n = 1;
+	    ++_stats.nmethods;
+	    return;
+	}
+    }
+}
+
+// Keeps the method table at most half full
+void AppL::grow_method_stats (void)
+{
+    vector<MethodStat> old;
+    old.swap (_stats.methods);
+    _stats.methods.resize (max (old.size()*2, decltype(old)::size_type(64)));
+    auto mask = _stats.methods.size()-1;
+    for (auto& o : old) {
+	if (!o.method)
+	    continue;
+	auto i = method_stat_hash (o.method) >> (64-log2p1(mask));
+	while (_stats.methods[i].method)
+	    i = (i+1) & mask;
+	_stats.methods[i] = o;
+    }
+}
+
+void AppL::count_iteration (uint64_t depth, nstime_t busyns)
+{
+    ++_stats.c.iterations;
+    _stats.c.busyns += busyns;
+    _stats.c.maxdepth = max (_stats.c.maxdepth, depth);
+    ++_stats.busyhist[histogram_bin (busyns)];
+    ++_stats.depthhist[histogram_bin (depth)];
+}
+
+void AppL::count_wait (nstime_t start)
+{
+    ++_stats.c.waits;
+    _stats.c.waitns += ITimer::now() - start;
+}
+
+void AppL::Stats::Stats_get (void) const
+{
+    auto& st = AppL::instance()._stats;
+    vector<IStats::MethodCount> methods;
+    methods.reserve (st.nmethods);
+    for (auto& s : st.methods)
+	if (s.method)
+	    methods.push_back (IStats::MethodCount { s.n, interface_of_method (s.method), s.method });
+    reply<IStats>().stats (st.c, st.busyhist, st.depthhist, methods);
+}
+
+IMPLEMENT_INTERFACES_D (AppL::Stats)
+
+//}}}-------------------------------------------------------------------
+//{{{ Broadcast subscriptions
+
+bool AppL::dispatch_broadcast (Msg& msg)
+{
+    // Msgers created since the last broadcast are fully constructed now
+    subscribe_new_msgers();
+
+    // Msgers accepting the interface, and those not saying what they accept,
+    // are visited in mrid order. The bitmaps may grow during dispatch.
+    auto isi = subscribers_index (msg.interface());
+    auto asi = subscribers_index (nullptr);
+    auto subscriber_word = [&](unsigned si, unsigned w)
+	{ auto& b = _subscribers[si].mrids; return w < b.size() ? b[w] : 0; };
+    for (auto w = 0u, nw = divide_ceil (_msgers.size(), bits_in_type<uint64_t>::value); w < nw; ++w) {
+	for (auto bits = subscriber_word (isi, w) | subscriber_word (asi, w); bits; bits &= bits-1) {
+	    mrid_t mg = w*bits_in_type<uint64_t>::value + __builtin_ctzll (bits);
+	    if (mg < _msgers.size() && !dispatch_to (mg, msg))
+		return false;
+	}
+    }
+    return true;
+}
+
+unsigned AppL::subscribers_index (iid_t iface)
+{
+    for (auto i = 0u; i < _subscribers.size(); ++i)
+	if (_subscribers[i].iface == iface)
+	    return i;
+    _subscribers.emplace_back (Subscribers { iface, {} });
+    return _subscribers.size()-1;
+}
+
+void AppL::subscribe_new_msgers (void)
+{
+    for (auto id : _newmsgers) {
+	auto m = msger_by_id (id);
+	if (!m)
+	    continue;	// deleted before the first broadcast
+	auto subscribe = [&](iid_t iface) {
+	    auto& b = _subscribers[subscribers_index (iface)].mrids;
+	    auto wi = id / bits_in_type<uint64_t>::value;
+	    if (b.size() <= wi)
+		b.resize (wi+1);
+	    set_bit (b[wi], id % bits_in_type<uint64_t>::value);
+	};
+	auto ifaces = m->dispatched_interfaces();
+	if (!ifaces)
+	    subscribe (nullptr);
+	else for (; *ifaces; ++ifaces)
+	    subscribe (*ifaces);
+    }
+    _newmsgers.clear();
+}
+
+void AppL::unsubscribe_msger (mrid_t id)
+{
+    auto wi = id / bits_in_type<uint64_t>::value;
+    for (auto& s : _subscribers)
+	if (wi < s.mrids.size())
+	    set_bit (s.mrids[wi], id % bits_in_type<uint64_t>::value, false);
+}
+
+#if USE_EPOLL
+// epoll_pwait with a ns timeout, using epoll_pwait2 when available
+static int epoll_pwait_ns (int epfd, epoll_event* evs, int maxevs, int64_t timeout, const sigset_t* sigmask)
+{
+    #if USE_EPOLL_PWAIT2
+	static bool s_no_epoll_pwait2 = false;	// before Linux 5.11
+	if (!s_no_epoll_pwait2) {
+	    const timespec ts = { long(timeout / 1000000000), long(timeout % 1000000000) };
+	    auto r = epoll_pwait2 (epfd, evs, maxevs, timeout < 0 ? nullptr : &ts, sigmask);
+	    if (r >= 0 || errno != ENOSYS)
+		return r;
+	    s_no_epoll_pwait2 = true;
+	}
+    #endif
+    // epoll_pwait takes ms; round up to not wake before the deadline
+    int timeoutms = timeout < 0 ? -1 : min (divide_ceil (timeout, 1000000), int64_t(INT_MAX));
+    return epoll_pwait (epfd, evs, maxevs, timeoutms, sigmask);
+}
+#endif
+
 void AppL::run_timers (void)
 {
-    // All message signals must be blocked between forward_received_signals and ppoll
-    sigset_t msgsigs = {}, origsigs = {};
-    for (auto i = 0u; i < NSIG; ++i)
-	if (get_bit (sigset_Msg, i))
-	    sigaddset (&msgsigs, i);
-    sigprocmask (SIG_BLOCK, &msgsigs, &origsigs);
-    auto unblocksigs = make_scope_exit ([&]{ sigprocmask (SIG_SETMASK, &origsigs, NULL); });
+    // A signal arriving between forward_received_signals and the wait
+    // makes s_sigwakefd readable, ending the wait. Without it, message
+    // signals must be blocked in between, and unblocked by the wait.
+    sigset_t origsigs = {};
+    const sigset_t* waitsigs = nullptr;
+    if (s_sigwakefd < 0) {
+	sigset_t msgsigs = {};
+	for (auto i = 0u; i < NSIG; ++i)
+	    if (get_bit (sigset_Msg, i))
+		sigaddset (&msgsigs, i);
+	sigprocmask (SIG_BLOCK, &msgsigs, &origsigs);
+	waitsigs = &origsigs;
+    }
+    auto unblocksigs = make_scope_exit ([&]{ if (waitsigs) sigprocmask (SIG_SETMASK, waitsigs, NULL); });
 
     // Convert received signals to messages
     forward_received_signals();
@@ -326,19 +938,21 @@ void AppL::run_timers (void)
     // See if there are any timers to wait on
     auto ntimers = has_timers();
     if (!ntimers || flag (f_Quitting)) {
-	if (_outq.empty()) {
+	if (!outq_size()) {
 	    debug_printf ("Warning: ran out of packets. Quitting.\n");
 	    quit();	// running out of packets is usually not what you want, but not exactly an error
 	}
 	return;
     }
 
-    // Populate the fd list and find the nearest timer
-    pollfd fds [ntimers];
-    int timeout;
-    auto nfds = get_poll_timer_list (fds, ntimers, timeout);
+    // Populate the fd list and find the nearest timer.
+    // With epoll or io_uring, the fds are already in the poll set.
+    pollfd fds [uses_poll_set() ? 1 : ntimers+1];	// and s_sigwakefd
+    int64_t timeout;
+    auto nfds = uses_poll_set() ? get_poll_timer_list (nullptr, 0, timeout)
+				: get_poll_timer_list (fds, ntimers, timeout);
     if (!nfds && !timeout) {
-	if (_outq.empty()) {
+	if (!outq_size()) {
 	    debug_printf ("Warning: ran out of packets. Quitting.\n");
 	    quit();	// running out of packets is usually not what you want, but not exactly an error
 	}
@@ -349,7 +963,7 @@ void AppL::run_timers (void)
     if (debug_tracing_on()) {
 	debug_printf ("----------------------------------------------------------------------\n");
 	if (timeout > 0)
-	    debug_printf ("[I] Waiting for %d ms ", timeout);
+	    debug_printf ("[I] Waiting for %ld ns ", timeout);
 	else if (timeout < 0)
 	    debug_printf ("[I] Waiting indefinitely ");
 	else if (!timeout)
@@ -358,10 +972,38 @@ void AppL::run_timers (void)
     }
 
     // And poll
-    uint64_t timeout_ns = timeout * 1000000;
-    const timespec ts = { long(timeout_ns / 1000000000), long(timeout_ns % 1000000000) };
-    if (0 > ppoll (fds, nfds, &ts, &origsigs) && errno != EINTR)
+    const timespec ts = { long(timeout / 1000000000), long(timeout % 1000000000) };
+    auto waitstart = ITimer::now();
+    #if USE_URING
+	if (_uring.is_open()) {
+	    // Poll requests queued by update_fd_watch are submitted by the same
+	    // syscall. Checking without waiting is much faster than a zero timeout.
+	    auto r = _uring.submit_and_wait (!!timeout, timeout > 0 ? &ts : nullptr, waitsigs);
+	    count_wait (waitstart);
+	    if (0 > r && errno != EINTR && errno != ETIME)
+		error_libc ("io_uring_enter");
+	    return check_uring_timers();
+	}
+    #endif
+    #if USE_EPOLL
+	if (_epfd >= 0) {
+	    epoll_event evs [64];
+	    auto nevs = epoll_pwait_ns (_epfd, evs, size(evs), timeout, waitsigs);
+	    count_wait (waitstart);
+	    if (nevs < 0 && errno != EINTR)
+		error_libc ("epoll_pwait");
+	    return check_epoll_timers (evs, max (nevs, 0));
+	}
+    #endif
+    auto nwaitfds = nfds;
+    if (s_sigwakefd >= 0)
+	fds[nwaitfds++] = { s_sigwakefd, POLLIN, 0 };
+    auto r = ppoll (fds, nwaitfds, timeout < 0 ? nullptr : &ts, waitsigs);
+    count_wait (waitstart);
+    if (0 > r && errno != EINTR)
 	error_libc ("ppoll");
+    if (nwaitfds > nfds && r > 0 && fds[nfds].revents)
+	drain_signal_wake();
 
     // Then, check timers for expiration
     check_poll_timers (fds);
@@ -369,7 +1011,8 @@ void AppL::run_timers (void)
 
 void AppL::forward_received_signals (void)
 {
-    auto oldrs = s_received_signals;
+    // Signals arriving after this are left for the next call
+    auto oldrs = __atomic_exchange_n (&s_received_signals, 0, int(memory_order::acq_rel));
     if (!oldrs)
 	return;
     ISignal psig (mrid_App);
@@ -384,51 +1027,176 @@ void AppL::forward_received_signals (void)
 	}
 	psig.signal (si);
     }
-    // clear only the signal bits processed, in case new signals arrived during the loop
-    s_received_signals ^= oldrs;
 }
 
-AppL::msgq_t::size_type AppL::has_messages_for (mrid_t mid) const
+//}}}-------------------------------------------------------------------
+//{{{ Posting from other threads
+
+// Must be called on the loop thread before other threads call post.
+// The eventfd is watched with a Timer, so AppL::Timer must be in the
+// app's Msger list. The watch keeps the loop running until quit.
+void AppL::open_post_queue (void)
+{
+    if (_postfd >= 0)
+	return;
+    if (0 > (_postfd = eventfd (0, EFD_NONBLOCK| EFD_CLOEXEC)))
+	return error_libc ("eventfd");
+    create_dest_with (nullptr, &Msger::factory<PostWatch>, Msg::Link { mrid_App, allocate_mrid (mrid_App) });
+}
+
+// Queues msg for delivery from any thread. The destination Msger must
+// already exist or be creatable through the app's factory map.
+void AppL::post (Msg&& msg)
+{
+    assert (_postfd >= 0 && "You must call open_post_queue before posting");
+    auto p = new PostedMsg { __atomic_load_n (&_posted, int(memory_order::relaxed)), move(msg) };
+    while (!__atomic_compare_exchange_n (&_posted, &p->next, p, true, int(memory_order::release), int(memory_order::relaxed)))
+	tight_loop_pause();
+    // Only the post to an empty stack needs to wake the loop;
+    // later ones will be drained together with it.
+    if (!p->next) {
+	uint64_t one = 1;
+	if (0 > write (_postfd, &one, sizeof(one)) && errno != EAGAIN)
+	    perror ("eventfd write");
+    }
+}
+
+void AppL::drain_posted (void)
+{
+    // Take the whole stack and reverse it into posting order
+    PostedMsg* first = nullptr;
+    for (auto p = __atomic_exchange_n (&_posted, nullptr, int(memory_order::acquire)); p;) {
+	auto next = exchange (p->next, first);
+	first = exchange (p, next);
+    }
+    while (first) {
+	auto& msg = first->msg;
+	if (valid_msger_id (msg.src()))
+	    create_method_dest (msg.method(), msg.link());
+	requeue_msg (move(msg));
+	delete exchange (first, first->next);
+    }
+}
+
+AppL::PostWatch::PostWatch (Msg::Link l)
+: Msger (l)
+,_timer (msger_id())
+{
+    _timer.wait_read (AppL::instance()._postfd);
+}
+
+void AppL::PostWatch::Timer_timer (fd_t fd)
 {
-    return count_if (_outq, [=](auto& msg){ return msg.dest() == mid; });
+    // Reset the eventfd before draining, so that a post racing
+    // with the drain signals it again and is not missed.
+    uint64_t n;
+    if (0 > read (fd, &n, sizeof(n)) && errno != EAGAIN)
+	return error_libc ("eventfd read");
+    AppL::instance().drain_posted();
+    _timer.wait_read (fd);
+}
+
+IMPLEMENT_INTERFACES_D (AppL::PostWatch)
+
+//}}}-------------------------------------------------------------------
+//{{{ Output queue index
+
+static inline auto outq_slot_hash (methodid_t mid, Msg::Link l)
+{
+    // Fibonacci hashing; the top bits are used
+    return (uintptr_t(mid) ^ uint64_t(l.to_int()) << 20) * UINT64_C(0x9e3779b97f4a7c15);
 }
 
 Msg* AppL::has_outq_msg (methodid_t mid, Msg::Link l)
 {
-    eachfor (mi, _outq)
-	if (mi->method() == mid && mi->link() == l)
-	    return mi;
-    return nullptr;
+    if (_outqidx.empty())
+	return nullptr;
+    auto mask = _outqidx.size()-1;
+    for (auto i = outq_slot_hash (mid,l) >> (64-log2p1(mask)); ; i = (i+1) & mask) {
+	auto& s = _outqidx[i];
+	if (s.gen != _outqgen)
+	    return nullptr;
+	if (s.method == mid && s.link == l)
+	    return &_outq[s.lane][s.i];
+    }
+}
+
+void AppL::index_outq_msg (uint8_t lane, msgq_t::size_type qi)
+{
+    // Keep the table at most half full, rebuilding it when grown
+    if (auto n = outq_size(); _outqidx.size() < 2*n) {
+	_outqidx.clear();	// zeroed slots are from no generation
+	_outqidx.resize (max (msgq_t::size_type(64), ceil2 (2*n)));
+	for (uint8_t l = 0; l < NPriorities; ++l)
+	    for (auto i = 0u; i < (l == lane ? qi : _outq[l].size()); ++i)
+		index_outq_msg (l, i);
+    }
+    auto& msg = _outq[lane][qi];
+    auto mask = _outqidx.size()-1;
+    for (auto i = outq_slot_hash (msg.method(), msg.link()) >> (64-log2p1(mask)); ; i = (i+1) & mask) {
+	auto& s = _outqidx[i];
+	if (s.gen != _outqgen) {
+	    s.method = msg.method();
+	    s.link = msg.link();
+	    s.gen = _outqgen;
+	    s.i = qi;
+	    s.lane = lane;
+	    return;
+	}
+	if (s.method == msg.method() && s.link == msg.link())
+	    return;	// lookups find the first queued message, as a scan would
+    }
+}
+
+AppL::msgq_t::size_type AppL::outq_size (void) const
+{
+    msgq_t::size_type n = 0;
+    for (auto& q : _outq)
+	n += q.size();
+    return n;
+}
+
+void AppL::clear_outq_index (void)
+{
+    if (!++_outqgen) {	// on wraparound, old slots may look current
+	zero_fill (_outqidx.begin(), _outqidx.end());
+	_outqgen = 1;
+    }
 }
 
 //}}}-------------------------------------------------------------------
 //{{{ Timers
 
-unsigned AppL::get_poll_timer_list (pollfd* pfd, unsigned pfdsz, int& timeout) const
+unsigned AppL::get_poll_timer_list (pollfd* pfd, unsigned pfdsz, int64_t& timeout) const
 {
     // Put all valid fds into the pfd list and calculate the nearest timeout
     // Note that there may be a timeout without any fds
     //
     auto npfd = 0u;
-    auto nearest = ITimer::TimerMax;
-    for (auto t : _timers) {
-	if (t->cmd() == ITimer::WatchCmd::Stop)
+    if (!pfd)	// the epoll set counts its own fds
+	npfd = _nfdtimers;
+    else for (auto t : _timers) {
+	if (!t->watches_fd())
 	    continue;
-	nearest = min (nearest, t->next_fire());
-	if (t->fd() >= 0) {
-	    if (npfd >= pfdsz)
-		break;
-	    pfd[npfd].fd = t->fd();
-	    pfd[npfd].events = int(t->cmd());
-	    pfd[npfd++].revents = 0;
-	}
+	if (npfd >= pfdsz)
+	    break;
+	pfd[npfd].fd = t->fd();
+	pfd[npfd].events = int(t->cmd());
+	pfd[npfd++].revents = 0;
     }
-    if (!_outq.empty())
+    // The nearest deadline is at the top of the heap. Waiting for
+    // the slack past it allows the following timers to fire with it.
+    auto nearest = ITimer::TimerMax;
+    if (!_timerq.empty())
+	nearest = min (_timerq[0]->next_fire(), ITimer::TimerMax-_timerslack) + _timerslack;
+    if (outq_size())
 	timeout = 0;	// do not wait if there are messages to process
     else if (nearest == ITimer::TimerMax)	// wait indefinitely
 	timeout = -!!npfd;	// if no fds, then don't wait at all
-    else // get current time and compute timeout to nearest
-	timeout = max (nearest - chrono::system_clock::now(), 0);
+    else { // get current time and compute timeout to nearest
+	auto now = ITimer::now();
+	timeout = nearest > now ? nearest - now : 0;
+    }
     return npfd;
 }
 
@@ -436,32 +1204,306 @@ void AppL::check_poll_timers (const pollfd* fds)
 {
     // Poll errors are checked for each fd with POLLERR. Other errors are ignored.
     // poll will exit when there are fds available or when the timer expires
-    auto now = chrono::system_clock::now();
     const auto* cfd = fds;
     for (auto t : _timers) {
-	bool expired = t->next_fire() <= now,
-	    hasfd = (t->fd() >= 0 && t->cmd() != ITimer::WatchCmd::Stop),
-	    fdon = hasfd && cfd->revents;
-
-	// Log the firing if tracing
-	if (debug_tracing_on()) {
-	    if (expired)
-		debug_printf("[T]\tTimer %lu fired at %lu\n", t->next_fire(), now);
-	    if (fdon) {
+	if (!t->watches_fd())
+	    continue;
+	if (cfd->revents) {
+	    // Log the firing if tracing
+	    if (debug_tracing_on()) {
 		debug_printf("[T]\tFile descriptor %d ", cfd->fd);
 		if (cfd->revents & POLLIN)	debug_printf("can be read\n");
 		if (cfd->revents & POLLOUT)	debug_printf("can be written\n");
 		if (cfd->revents & POLLPRI)	debug_printf("has extra data\n");
 		if (cfd->revents & POLLERR)	debug_printf("has errors\n");
 	    }
+	    // Firing the timer will remove it (on next idle)
+	    t->fire();
 	}
+	++cfd;
+    }
+    fire_expired_timers();
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ Timer deadline heap
+
+void AppL::schedule_timer (Timer* t)
+{
+    assert (t->_qpos == Timer::NotScheduled);
+    t->_qpos = _timerq.size();
+    _timerq.push_back (t);
+    sift_timer_up (t->_qpos);
+}
 
-	// Firing the timer will remove it (on next idle)
-	if (expired || fdon)
+void AppL::unschedule_timer (Timer* t)
+{
+    auto i = exchange (t->_qpos, Timer::NotScheduled);
+    if (i == Timer::NotScheduled)
+	return;
+    // Move the last Timer into the hole and restore the heap order
+    auto last = _timerq.back();
+    _timerq.pop_back();
+    if (i == _timerq.size())
+	return;
+    _timerq[i] = last;
+    last->_qpos = i;
+    sift_timer_down (i);
+    sift_timer_up (last->_qpos);
+}
+
+bool AppL::timer_before (unsigned i, unsigned j) const
+{
+    // Timers with the same deadline fire in order of creation
+    auto ti = _timerq[i], tj = _timerq[j];
+    return ti->next_fire() < tj->next_fire()
+	|| (ti->next_fire() == tj->next_fire() && ti->msger_id() < tj->msger_id());
+}
+
+void AppL::swap_timers (unsigned i, unsigned j)
+{
+    swap (_timerq[i], _timerq[j]);
+    _timerq[i]->_qpos = i;
+    _timerq[j]->_qpos = j;
+}
+
+void AppL::sift_timer_up (unsigned i)
+{
+    for (unsigned p; i && timer_before (i, p = (i-1)/2); i = p)
+	swap_timers (i, p);
+}
+
+void AppL::sift_timer_down (unsigned i)
+{
+    for (unsigned c; (c = 2*i+1) < _timerq.size(); i = c) {
+	if (c+1 < _timerq.size() && timer_before (c+1, c))
+	    ++c;
+	if (!timer_before (c, i))
+	    break;
+	swap_timers (i, c);
+    }
+}
+
+void AppL::fire_expired_timers (void)
+{
+    // Firing stops the Timer, removing it from the heap
+    auto now = ITimer::now();
+    while (!_timerq.empty() && _timerq[0]->next_fire() <= now) {
+	auto t = _timerq[0];
+	debug_printf("[T]\tTimer %lu fired at %lu\n", t->next_fire(), now);
+	t->fire();
+    }
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ Poll set timers
+
+void AppL::remove_timer (Timer* t)
+{
+    auto fd = t->watches_fd() ? t->fd() : -1;
+    unlink_fd_timer (t);
+    update_fd_watch (fd);
+    unschedule_timer (t);
+    remove (_timers, t);
+}
+
+void AppL::link_fd_timer (Timer* t)
+{
+    if (!uses_poll_set() || !t->watches_fd())
+	return;
+    if (_fdwatch.size() <= size_t(t->fd()))
+	_fdwatch.resize (t->fd()+1);
+    auto& w = _fdwatch[t->fd()];
+    t->_nextonfd = exchange (w.timers, t);
+    ++_nfdtimers;
+}
+
+void AppL::unlink_fd_timer (Timer* t)
+{
+    if (!uses_poll_set() || !t->watches_fd())
+	return;
+    for (auto pt = &_fdwatch[t->fd()].timers; *pt; pt = &(*pt)->_nextonfd) {
+	if (*pt == t) {
+	    *pt = exchange (t->_nextonfd, nullptr);
+	    --_nfdtimers;
+	    break;
+	}
+    }
+}
+
+#if USE_URING
+// The ring replaces only the readiness wait: each watched fd has a
+// poll request, and the Msgers do their I/O synchronously when woken.
+// io_uring completion tags identify the fd and the poll request generation
+static constexpr uint64_t uring_poll_tag (int fd, uint16_t gen)
+    { return uint64_t(gen) << 32 | uint32_t(fd); }
+static constexpr uint64_t uring_IgnoredTag = UINT64_MAX;	// an invalid fd
+static constexpr uint64_t uring_SignalTag = UINT64_MAX-1;	// also an invalid fd
+#endif
+
+// Adds s_sigwakefd to the poll set. ppoll adds it on each call.
+void AppL::watch_signal_wake (void)
+{
+    if (s_sigwakefd < 0)
+	return;
+#if USE_URING
+    if (_uring.is_open()) {	// oneshot, rearmed on completion
+	auto sqe = _uring.get_sqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = s_sigwakefd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = uring_SignalTag;
+	return;
+    }
+#endif
+#if USE_EPOLL
+    if (_epfd >= 0) {	// level triggered, until drained
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = s_sigwakefd;
+	if (0 > epoll_ctl (_epfd, EPOLL_CTL_ADD, s_sigwakefd, &ev))
+	    error_libc ("epoll_ctl");
+    }
+#endif
+}
+
+// Resets s_sigwakefd after waking; the signals are then forwarded
+// before the next wait, having been recorded before the wake.
+void AppL::drain_signal_wake (void) // static
+{
+    uint64_t n;
+    [[maybe_unused]] auto r = read (s_sigwakefd, &n, sizeof(n));
+}
+
+void AppL::update_fd_watch (fd_t fd, bool force)
+{
+    if (!uses_poll_set() || fd < 0 || size_t(fd) >= _fdwatch.size())
+	return;
+    auto& w = _fdwatch[fd];
+    uint32_t events = 0;
+    for (auto t = w.timers; t; t = t->_nextonfd)
+	events |= uint32_t(t->cmd());	// poll, epoll, and io_uring event bits are the same
+    if (events == w.events && !force)
+	return;
+
+#if USE_URING
+    if (_uring.is_open()) {
+	// Poll requests are oneshot and can not be modified, so changes
+	// replace the request with one of the next generation, so that
+	// any already queued completions of the old one can be ignored.
+	// The requests are submitted when the message loop next waits.
+	if (w.added) {
+	    auto sqe = _uring.get_sqe();
+	    sqe->opcode = IORING_OP_POLL_REMOVE;
+	    sqe->addr = uring_poll_tag (fd, w.gen);
+	    sqe->user_data = uring_IgnoredTag;
+	}
+	if ((w.added = events)) {
+	    auto sqe = _uring.get_sqe();
+	    sqe->opcode = IORING_OP_POLL_ADD;
+	    sqe->fd = fd;
+	    sqe->poll32_events = events;
+	    sqe->user_data = uring_poll_tag (fd, ++w.gen);
+	}
+	w.events = events;
+	return;
+    }
+#endif
+#if USE_EPOLL
+
+    // Registrations are oneshot, so a fired fd is disarmed, but remains
+    // in the set to be rearmed with MOD, saving a syscall on each rewatch.
+    int op = EPOLL_CTL_DEL;
+    if (events)
+	op = w.added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    else if (!w.added)
+	return;
+    epoll_event ev = {};
+    ev.events = events| EPOLLONESHOT;
+    ev.data.fd = fd;
+    auto r = epoll_ctl (_epfd, op, fd, &ev);
+    // The kernel silently removes closed fds from the set, so the fd
+    // may have since been reused, making added flag incorrect.
+    if (r < 0 && ((op == EPOLL_CTL_MOD && errno == ENOENT) || (op == EPOLL_CTL_ADD && errno == EEXIST)))
+	r = epoll_ctl (_epfd, op = (op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD), fd, &ev);
+    if (r < 0 && op != EPOLL_CTL_DEL) {
+	// Regular files and some devices can not be epolled.
+	// These are always ready, and ppoll handles them properly.
+	debug_printf ("[T] epoll_ctl on fd %d failed: %s. Switching to ppoll.\n", fd, strerror(errno));
+	close (exchange (_epfd, -1));
+	_fdwatch.clear();
+	_nfdtimers = 0;
+	for (auto t : _timers)
+	    t->_nextonfd = nullptr;
+	return;
+    }
+    w.added = (op != EPOLL_CTL_DEL);
+    w.events = events;
+#endif
+}
+
+void AppL::check_epoll_timers (const epoll_event* evs [[maybe_unused]], unsigned nevs [[maybe_unused]])
+{
+#if USE_EPOLL
+    for (auto e = evs, eend = evs+nevs; e < eend; ++e) {
+	if (e->data.fd == s_sigwakefd)
+	    drain_signal_wake();
+	else if (size_t(e->data.fd) < _fdwatch.size())
+	    fire_fd_timers (e->data.fd, e->events);
+    }
+    fire_expired_timers();
+#endif
+}
+
+void AppL::check_uring_timers (void)
+{
+#if USE_URING
+    for (const io_uring_cqe* cqe; (cqe = _uring.peek_cqe());) {
+	auto tag = cqe->user_data;
+	auto res = cqe->res;
+	_uring.pop_cqe();
+	if (tag == uring_SignalTag) {
+	    drain_signal_wake();
+	    watch_signal_wake();
+	    continue;
+	}
+	// Skips removal completions, cancelled requests, and
+	// late completions of requests since replaced.
+	fd_t fd = uint32_t(tag);
+	if (res <= 0 || size_t(fd) >= _fdwatch.size())
+	    continue;
+	auto& w = _fdwatch[fd];
+	if (!w.added || tag != uring_poll_tag (fd, w.gen))
+	    continue;
+	w.added = false;	// a completed poll request is gone
+	fire_fd_timers (fd, res);
+    }
+    fire_expired_timers();
+#endif
+}
+
+void AppL::fire_fd_timers (fd_t fd, uint32_t events)
+{
+    if (debug_tracing_on()) {
+	debug_printf("[T]\tFile descriptor %d ", fd);
+	if (events & POLLIN)	debug_printf("can be read\n");
+	if (events & POLLOUT)	debug_printf("can be written\n");
+	if (events & POLLPRI)	debug_printf("has extra data\n");
+	if (events & POLLERR)	debug_printf("has errors\n");
+    }
+    // Delivery disarms the oneshot registration. Fire the Timers
+    // waiting for the delivered events, and rearm for the rest.
+    auto& w = _fdwatch[fd];
+    w.events = 0;
+    for (auto t = w.timers; t;) {
+	auto tnext = t->_nextonfd;
+	if (events & (uint32_t(t->cmd())| POLLERR| POLLHUP))
 	    t->fire();
-	cfd += hasfd;
+	t = tnext;
     }
+    update_fd_watch (fd);
 }
 
+
 } // namespace cwiclo
 //}}}-------------------------------------------------------------------
@@ -5,14 +5,17 @@
 
 #pragma once
 #include "xcom.h"
+#include "trace.h"
 #include <sys/poll.h>
 
+struct epoll_event;
+
 //{{{ ITimer -----------------------------------------------------------
 
 namespace cwiclo {
 
 class ITimer : public Interface {
-    DECLARE_INTERFACE (Interface, Timer, (watch,"uix")(timer,"i"))
+    DECLARE_INTERFACE (Interface, Timer, (watch,"uix")(watch_until,"uix")(timer,"i"))
 public:
     enum class WatchCmd : uint32_t {
 	Stop		= 0,
@@ -24,27 +27,34 @@ public:
 	WriteTimer	= Write| Timer,
 	ReadWriteTimer	= ReadWrite| Timer
     };
-    using mstime_t = uint64_t;
+    using mstime_t = uint64_t;	// relative timeout in milliseconds
+    using nstime_t = uint64_t;	// steady_clock deadline in nanoseconds
     static constexpr mstime_t TimerMax = INT64_MAX;
     static constexpr mstime_t TimerNone = UINT64_MAX;
 public:
     explicit	ITimer (mrid_t caller) : Interface (caller) {}
+    constexpr	ITimer (mrid_t caller, mrid_t dest) : Interface (caller, dest) {}
     void	watch (WatchCmd cmd, fd_t fd, mstime_t timeoutms = TimerNone) const;
+    void	watch_until (WatchCmd cmd, fd_t fd, nstime_t deadline) const;
     void	stop (void) const				{ watch (WatchCmd::Stop, -1, TimerNone); }
     void	timer (mstime_t timeoutms) const		{ watch (WatchCmd::Timer, -1, timeoutms); }
+    void	timer_until (nstime_t deadline) const		{ watch_until (WatchCmd::Timer, -1, deadline); }
     void	wait_read (fd_t fd, mstime_t t=TimerNone) const	{ watch (WatchCmd::Read, fd, t); }
     void	wait_write (fd_t fd, mstime_t t=TimerNone)const	{ watch (WatchCmd::Write, fd, t); }
     void	wait_rdWr (fd_t fd, mstime_t t=TimerNone) const	{ watch (WatchCmd::ReadWrite, fd, t); }
+    static auto	now (void)					{ return chrono::steady_clock::now(); }
 
     template <typename O>
     inline static constexpr bool dispatch (O* o, const Msg& msg) {
-	if (msg.method() != m_watch())
+	if (msg.method() != m_watch() && msg.method() != m_watch_until())
 	    return Interface::dispatch (o, msg);
 	auto is = msg.read();
 	auto cmd = is.read<WatchCmd>();
 	auto fd = is.read<fd_t>();
-	auto timer = is.read<mstime_t>();
-	o->Timer_watch (cmd, fd, timer);
+	if (msg.method() == m_watch())
+	    o->Timer_watch (cmd, fd, is.read<mstime_t>());
+	else
+	    o->Timer_watch_until (cmd, fd, is.read<nstime_t>());
 	return true;
     }
 public:
@@ -90,6 +100,72 @@ public:
     using Reply = ISignal;
 };
 
+//}}}-------------------------------------------------------------------
+//{{{ Stats interface
+
+// Message loop counters, kept by AppL and reported by AppL::Stats.
+// Can be exported, to monitor another process through Extern.
+class IStats : public Interface {
+    #define SIGNATURE_Stats_Counters	"(xxxxxxxxx)"
+    #define SIGNATURE_Stats_MethodCount	"(xss)"
+    DECLARE_INTERFACE (Interface, Stats, (get,"")(stats,SIGNATURE_Stats_Counters "axax" "a" SIGNATURE_Stats_MethodCount))
+public:
+    enum { NHistBins = 32 };	// bin i counts values in [2^(i-1),2^i), the last bin all above
+    struct Counters {
+	uint64_t	iterations;	// of the message loop
+	uint64_t	dispatched;	// messages, counting a broadcast once
+	uint64_t	busyns;		// spent dispatching
+	uint64_t	waits;		// for timers and fds
+	uint64_t	waitns;
+	uint64_t	timers;		// fired
+	uint64_t	created;	// Msgers
+	uint64_t	deleted;
+	uint64_t	maxdepth;	// most messages dispatched in one iteration
+    };
+    using histogram_t = uint64_t [NHistBins];
+    struct MethodCount {
+	uint64_t	n;
+	string_view	iface;
+	string_view	method;
+    public:
+	static constexpr const streamsize stream_alignment = alignof(uint64_t);
+	void		read (istream& is)		{ is >> n >> iface >> method >> ios::talign<uint64_t>(); }
+	template <typename Stm>
+	void		write (Stm& os) const		{ os << n << iface << method << ios::talign<uint64_t>(); }
+    };
+public:
+    explicit	IStats (mrid_t caller)	: Interface (caller) {}
+    void	get (void) const	{ send (m_get()); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_get())
+	    return Interface::dispatch (o, msg);
+	o->Stats_get();
+	return true;
+    }
+public:
+    class Reply : public Interface::Reply {
+    public:
+	constexpr	Reply (Msg::Link l)	: Interface::Reply (l) {}
+	void		stats (const Counters& c, const histogram_t& busyhist, const histogram_t& depthhist, const vector<MethodCount>& methods) const
+			    { send (m_stats(), c, busyhist, depthhist, methods); }
+
+	template <typename O>
+	inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	    if (msg.method() != m_stats())
+		return Interface::Reply::dispatch (o, msg);
+	    auto is = msg.read();
+	    auto c = is.read<Counters>();
+	    vector<uint64_t> busyhist, depthhist;
+	    vector<MethodCount> methods;
+	    is >> busyhist >> depthhist >> methods;
+	    o->Stats_stats (c, busyhist, depthhist, methods);
+	    return true;
+	}
+    };
+};
+
 //}}}-------------------------------------------------------------------
 //{{{ AppL
 
@@ -98,8 +174,10 @@ public:
     using argc_t	= int;
     using argv_t	= char* const*;
     using mstime_t	= ITimer::mstime_t;
+    using nstime_t	= ITimer::nstime_t;
     using msgq_t	= vector<Msg>;
-    enum { f_Quitting = Msger::f_Last, f_DebugMsgTrace, f_Last };
+    enum { f_Quitting = Msger::f_Last, f_DebugMsgTrace, f_BatchDispatch, f_Last };
+    enum { LaneBurst = 64 };	// messages dispatched from higher lanes before one from a waiting lower lane
 public:
     static auto&	instance (void)			{ return *s_pApp; }
     static void		install_signal_handlers (void);
@@ -107,15 +185,28 @@ public:
     int			run (void);
     void		create_method_dest (methodid_t mid, Msg::Link l);
     void		create_dest_with (iid_t iid, Msger::pfn_factory_t fac, Msg::Link l);
-    inline Msg&		create_msg (Msg::Link l, methodid_t mid, streamsize size, Msg::fdoffset_t fdo = Msg::NoFdIncluded)
-			    { create_method_dest (mid,l); return _outq.emplace_back (l,mid,size,fdo); }
-    inline Msg&		create_msg (Msg::Link l, methodid_t mid, Msg::Body&& body, Msg::fdoffset_t fdo = Msg::NoFdIncluded, extid_t extid = 0)
-			    { create_method_dest (mid,l); return _outq.emplace_back (l,mid,move(body),fdo,extid); }
-    void		requeue_msg (Msg&& msg)		{ _outq.emplace_back (move(msg)); }
+    inline Msg&		create_msg (Msg::Link l, methodid_t mid, streamsize size, Msg::fdoffset_t fdo = Msg::NoFdIncluded);
+    inline Msg&		create_msg (Msg::Link l, methodid_t mid, Msg::Body&& body, Msg::fdoffset_t fdo = Msg::NoFdIncluded, extid_t extid = 0);
+    inline void		requeue_msg (Msg&& msg);
+    void		open_post_queue (void);
+    void		post (Msg&& msg);
     mrid_t		register_singleton_msger (Msger* m);
-    msgq_t::size_type	has_messages_for (mrid_t mid) const;
+    auto		has_messages_for (mrid_t mid) const	{ return mid < _noutq.size() ? _noutq[mid] : 0; }
+    void		add_unused_msger (mrid_t mid)	{ _unusedmsgers.push_back (mid); }
     Msg*		has_outq_msg (methodid_t mid, Msg::Link l);
+    void		set_inbox_limit (mrid_t mid, uint32_t n);
+    auto		inbox_limit (mrid_t mid) const	{ return mid < _inboxlimits.size() ? _inboxlimits[mid] : 0; }
+    bool		is_backlogged (Msg::Link l);
     constexpr auto	has_timers (void) const		{ return _timers.size(); }
+    constexpr auto	timer_slack (void) const	{ return _timerslack; }
+    constexpr void	set_timer_slack (nstime_t s)	{ _timerslack = s; }
+    constexpr auto	body_arena_size (void) const	{ return _bodyarenasize; }
+    constexpr void	set_body_arena_size (streamsize sz) { _bodyarenasize = sz; }
+    constexpr auto	batch_dispatch (void) const	{ return flag (f_BatchDispatch); }
+    constexpr void	set_batch_dispatch (bool v = true) { set_flag (f_BatchDispatch, v); }
+    auto&		msg_trace (void)		{ return _trace; }
+    constexpr auto	body_pool_size (void) const	{ return _bodypoolsize; }
+    constexpr void	set_body_pool_size (streamsize sz) { _bodypoolsize = sz; }
     bool		valid_msger_id (mrid_t id)const	{ assert (_msgers.size() == _creators.size()); return id < _msgers.size(); }
     Msger*		msger_by_id (mrid_t id)	const	{ return valid_msger_id(id) ? _msgers[id] : nullptr; }
     constexpr void	quit (void)			{ set_flag (f_Quitting); }
@@ -126,7 +217,7 @@ public:
     void		free_mrid (mrid_t id);
     void		message_loop_once (void);
     void		delete_msger (mrid_t mid);
-    unsigned		get_poll_timer_list (pollfd* pfd, unsigned pfdsz, int& timeout) const;
+    unsigned		get_poll_timer_list (pollfd* pfd, unsigned pfdsz, int64_t& timeoutns) const;
     void		check_poll_timers (const pollfd* fds);
     bool		forward_error (mrid_t oid, mrid_t eoid);
     inline void		errorv (const char* fmt, va_list args);
@@ -147,44 +238,238 @@ public:
     friend class Timer;
     class Timer : public Msger {
 	IMPLEMENT_INTERFACES_I (Msger, (ITimer),)
+    public:
+	enum : unsigned { NotScheduled = UINT_MAX };
     public:
 	explicit	Timer (Msg::Link l)
-			    : Msger(l),_nextfire(ITimer::TimerNone),_cmd(),_fd(-1)
+			    : Msger(l),_nextfire(ITimer::TimerNone),_nextonfd(),_cmd(),_fd(-1),_qpos(NotScheduled)
 			    { AppL::instance().add_timer (this); }
 			~Timer (void) override;
 	inline void	Timer_watch (ITimer::WatchCmd cmd, fd_t fd, mstime_t timeoutms);
-	constexpr void	stop (void)		{ set_flag (f_Unused); _cmd = ITimer::WatchCmd::Stop; _fd = -1; _nextfire = ITimer::TimerNone; }
-	void		fire (void)		{ reply<ITimer>().timer (_fd); stop(); }
+	void		Timer_watch_until (ITimer::WatchCmd cmd, fd_t fd, nstime_t deadline);
+	void		stop (void);
+	void		fire (void)		{ ++AppL::instance()._stats.c.timers; reply<ITimer>().timer (_fd); stop(); }
 	auto		fd (void) const		{ return _fd; }
 	auto		cmd (void) const	{ return _cmd; }
 	auto		next_fire (void) const	{ return _nextfire; }
 	auto		poll_mask (void) const	{ return _cmd; }
+	bool		watches_fd (void) const	{ return _fd >= 0 && _cmd != ITimer::WatchCmd::Stop; }
     public:
-	ITimer::mstime_t	_nextfire;
+	ITimer::nstime_t	_nextfire;
+	Timer*			_nextonfd;	// next Timer watching the same fd in the poll set
 	ITimer::WatchCmd	_cmd;
 	fd_t			_fd;
+	unsigned		_qpos;		// index in the deadline heap
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 PostWatch
+    // Wakes the loop when messages are posted from other threads
+    friend class PostWatch;
+    class PostWatch : public Msger {
+	IMPLEMENT_INTERFACES_I (Msger,,(ITimer))
+    public:
+	explicit	PostWatch (Msg::Link l);
+	void		Timer_timer (fd_t fd);
+    private:
+	ITimer		_timer;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 Stats
+    // Reports the loop counters. Add it to the app's Msger list to use
+    // IStats, and to the exported interfaces to monitor from elsewhere.
+    class Stats : public Msger {
+	IMPLEMENT_INTERFACES_I (Msger, (IStats),)
+    public:
+	explicit	Stats (Msg::Link l)	: Msger(l) {}
+	void		Stats_get (void) const;
     };
     //}}}2--------------------------------------------------------------
 private:
     inline static auto	msger_factory_for (iid_t id);
     [[nodiscard]] inline static Msger*	create_msger_with (Msg::Link l, iid_t iid, Msger::pfn_factory_t fac);
     [[nodiscard]] inline static auto	create_msger (Msg::Link l, iid_t iid);
+    inline static uint8_t lane_of (methodid_t mid)	{ return uint8_t (priority_of_method (mid)); }
+    inline Msg&		track_outq_msg (uint8_t lane);
+    msgq_t::size_type	outq_size (void) const;
+    inline Msg::iterator allocate_arena_body (streamsize sz);
+    void		reset_body_arena (void);
+    inline Msg::Body	take_pooled_body (streamsize sz);
+    void		recycle_inq_bodies (void);
+    void		trim_body_pool (streamsize sz);
+    void		update_free_mrid (mrid_t id);
+    void		link_child_mrid (mrid_t id);
+    void		unlink_child_mrid (mrid_t id);
+    mrid_t		first_free_mrid (void) const;
+    void		index_outq_msg (uint8_t lane, msgq_t::size_type i);
+    bool		is_inbox_full (mrid_t mid) const;
+    void		notify_drained (void);
+    void		clear_outq_index (void);
     inline void		process_input_queue (void);
+    inline bool		dispatch_inq_run (msgq_t& q, msgq_t::size_type& i);
+    inline bool		dispatch_inq_msg (Msg& msg);
+    inline void		trace_inq_msg (const Msg& msg) const;
+    inline void		count_dispatch (methodid_t mid);
+    void		grow_method_stats (void);
+    void		count_iteration (uint64_t depth, nstime_t busyns);
+    inline void		count_wait (nstime_t start);
+    void		group_by_dest (msgq_t& q);
+    void		group_run_by_dest (msgq_t& q, uint32_t f, uint32_t l);
+    bool		dispatch_batch_to (mrid_t mg, Msg* f, Msg* l);
+    inline bool		dispatch_to (mrid_t mg, Msg& msg);
+    bool		dispatch_broadcast (Msg& msg);
+    unsigned		subscribers_index (iid_t iface);
+    void		subscribe_new_msgers (void);
+    void		unsubscribe_msger (mrid_t id);
     inline void		delete_unused_msgers (void);
     inline void		forward_received_signals (void);
     void		add_timer (Timer* t)	{ _timers.push_back (t); }
-    void		remove_timer (Timer* t)	{ remove (_timers, t); }
+    void		remove_timer (Timer* t);
     void		run_timers (void);
+    void		link_fd_timer (Timer* t);
+    void		unlink_fd_timer (Timer* t);
+    void		update_fd_watch (fd_t fd, bool force = false);
+    void		check_epoll_timers (const epoll_event* evs, unsigned nevs);
+    void		check_uring_timers (void);
+    void		watch_signal_wake (void);
+    static void		drain_signal_wake (void);
+    void		fire_fd_timers (fd_t fd, uint32_t events);
+    void		fire_expired_timers (void);
+    void		drain_posted (void);
+    void		schedule_timer (Timer* t);
+    void		unschedule_timer (Timer* t);
+    inline void		sift_timer_up (unsigned i);
+    inline void		sift_timer_down (unsigned i);
+    inline bool		timer_before (unsigned i, unsigned j) const;
+    inline void		swap_timers (unsigned i, unsigned j);
+    bool		uses_poll_set (void) const	{ return _epfd >= 0 || _uring.is_open(); }
 private:
-    msgq_t		_outq;
-    msgq_t		_inq;
+    //{{{2 FdWatch -----------------------------------------------------
+    // The poll set registration of an fd and the Timers watching it
+    struct FdWatch {
+	Timer*		timers;
+	uint32_t	events;	// armed event mask; oneshot, so cleared on delivery
+	bool		added;	// fd is in the epoll set, or has an io_uring poll request
+	uint16_t	gen;	// io_uring poll request generation
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 MridLinks -------------------------------------------------
+    // Links each mrid into the list of mrids allocated by its creator
+    enum : mrid_t { mrid_None = mrid_Broadcast };
+    struct MridLinks {
+	mrid_t	firstchild;
+	mrid_t	nextsib;
+	mrid_t	prevsib;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 Subscribers -----------------------------------------------
+    // Bitmap of mrids whose Msgers dispatch iface, for broadcasts.
+    // Msgers with unknown interfaces are listed under null iface.
+    struct Subscribers {
+	iid_t			iface;
+	vector<uint64_t>	mrids;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 BodyArena -------------------------------------------------
+    // Message bodies created in one iteration are bump allocated here,
+    // and released wholesale after being processed in the next one.
+    struct BodyArena {
+	Msg::Body	mem;
+	streamsize	used;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 BodyPool ----------------------------------------------------
+    // Free lists of processed message bodies by power of 2 capacity,
+    // reused for new messages. Each free block starts with a pointer
+    // to the next one.
+    struct BodyPool {
+	enum : streamsize { MinClass = 6, NClasses = 11, DefaultSize = 64*1024 };	// 64 byte to 64k blocks
+	Msg::Body::pointer	free [NClasses];
+	streamsize		pooled;	// bytes in all free lists
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 GroupLink -------------------------------------------------
+    // Links of a message in group_by_dest, by index in the grouped run
+    struct GroupLink {
+	enum : uint32_t { None = UINT32_MAX };
+	uint32_t	prevsrc;	// previous message from the same sender
+	uint32_t	nextdest;	// next message to the same destination
+	bool		placed;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 LoopStats -------------------------------------------------
+    // Counters reported through IStats. Only incremented here; method
+    // names are looked up when reported.
+    struct MethodStat {
+	methodid_t	method;
+	uint64_t	n;
+    };
+    struct LoopStats {
+	IStats::Counters	c;
+	IStats::histogram_t	busyhist;	// iterations by dispatch time in ns
+	IStats::histogram_t	depthhist;	// iterations by messages dispatched
+	vector<MethodStat>	methods;	// open addressing hash table by method
+	uint32_t		nmethods;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 PostedMsg -------------------------------------------------
+    // Node in the stack of messages posted from other threads
+    struct PostedMsg {
+	PostedMsg*	next;
+	Msg		msg;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 OutqSlot ----------------------------------------------------
+    // Open addressing hash table slot indexing the first _outq message
+    // of each method and link. Slots from older generations are empty,
+    // so the whole table is cleared by incrementing the generation.
+    struct OutqSlot {
+	methodid_t	method;
+	Msg::Link	link;
+	uint32_t	gen;
+	uint32_t	i;	// index in _outq[lane]
+	uint8_t		lane;
+    };
+    //}}}2--------------------------------------------------------------
+private:
+    msgq_t		_outq [NPriorities];	// one for each priority lane
+    msgq_t		_inq [NPriorities];
     vector<Msger*>	_msgers;
     vector<Timer*>	_timers;
+    vector<Timer*>	_timerq;	// min-heap of Timers by next_fire
     vector<mrid_t>	_creators;
+    vector<MridLinks>	_mridlinks;	// never shrinks, unlike _creators
+    vector<Subscribers>	_subscribers;
+    vector<mrid_t>	_newmsgers;	// not yet in _subscribers
+    vector<mrid_t>	_unusedmsgers;	// flagged f_Unused, to be deleted when idle
+    BodyArena		_bodyarena [2];	// for _outq and for _inq
+    streamsize		_bodyarenasize;
+    BodyPool		_bodypool;
+    streamsize		_bodypoolsize;
+    vector<uint32_t>	_noutq;		// number of messages in _outq for each mrid
+    vector<uint32_t>	_inboxlimits;	// maximum _noutq for each mrid, if nonzero
+    vector<uint32_t>	_grouplast;	// group_by_dest last message from each src mrid
+    vector<uint32_t>	_grouphead;	// group_by_dest first unplaced message for each dest mrid
+    vector<GroupLink>	_grouplinks;	// group_by_dest links for each message in the run
+    memblock		_groupbuf;
+    vector<Msg::Link>	_backlogwaits;	// senders to notify when dest drains
+    LoopStats		_stats;
+    vector<OutqSlot>	_outqidx;	// hash index of _outq by method and link
+    uint32_t		_outqgen;	// current generation of _outqidx slots
+    uint64_t		_freemrids [divide_ceil (mrid_Last+1, 64)];	// bitmap of free mrids
+    uint64_t		_freemridwords [divide_ceil (mrid_Last+1, 64*64)];	// bitmap of nonzero _freemrids words
+    vector<FdWatch>	_fdwatch;
+    unsigned		_nfdtimers;
+    nstime_t		_timerslack;
+    fd_t		_epfd;
+    fd_t		_postfd;	// eventfd signalled by post
+    PostedMsg*		_posted;	// newest first, accessed atomically
+    URing		_uring;
+    MsgTrace		_trace;
     string		_errors;
     static AppL*	s_pApp;
     static int		s_exit_code;
     static uint32_t	s_received_signals;
+    static fd_t		s_sigwakefd;	// eventfd written by the signal handler to wake the wait
     static const MsgerFactoryMap* s_msger_factories;
 };
 
@@ -210,6 +495,72 @@ static inline void debug_printf (const Args&... args)
 
 //----------------------------------------------------------------------
 
+Msg& AppL::track_outq_msg (uint8_t lane)
+{
+    auto& msg = _outq[lane].back();
+    if (auto dest = msg.dest(); dest <= mrid_Last) {	// broadcasts are not counted
+	if (_noutq.size() <= dest)
+	    _noutq.resize (dest+1);
+	++_noutq[dest];
+    }
+    index_outq_msg (lane, _outq[lane].size()-1);
+    return msg;
+}
+
+Msg::iterator AppL::allocate_arena_body (streamsize sz)
+{
+    auto& a = _bodyarena[0];
+    auto asz = ceilg (sz, streamsize(16));	// Msg::data is assumed 16-aligned
+    if (a.used + asz > a.mem.capacity())
+	return nullptr;	// allocated on the heap when disabled or full
+    auto p = a.mem.begin() + exchange (a.used, a.used + asz);
+    zero_fill (p+sz, p+asz);	// zero out the alignment padding
+    return p;
+}
+
+Msg::Body AppL::take_pooled_body (streamsize sz)
+{
+    auto asz = ceilg (sz, Msg::Alignment::Body);
+    auto c = log2p1 (asz-1) - BodyPool::MinClass;	// smallest class that fits
+    if (c >= BodyPool::NClasses || !_bodypool.free[c])
+	return Msg::Body();
+    auto cap = streamsize(1) << (c + BodyPool::MinClass);
+    auto p = exchange (_bodypool.free[c], *pointer_cast<Msg::Body::pointer>(_bodypool.free[c]));
+    _bodypool.pooled -= cap;
+    zero_fill (p+sz, p+asz);	// zero out the alignment padding
+    return Msg::Body (p, sz, cap, false);
+}
+
+Msg& AppL::create_msg (Msg::Link l, methodid_t mid, streamsize size, Msg::fdoffset_t fdo)
+{
+    create_method_dest (mid,l);
+    auto lane = lane_of (mid);
+    if (size <= Msg::MaxInlineSize)
+	_outq[lane].emplace_back (l,mid,size,fdo);
+    else if (auto p = allocate_arena_body (size))	// linked to the arena
+	_outq[lane].emplace_back (l,mid,Msg::Body (p,size,0,false),fdo);
+    else if (auto b = take_pooled_body (size); !b.empty())
+	_outq[lane].emplace_back (l,mid,move(b),fdo);
+    else
+	_outq[lane].emplace_back (l,mid,size,fdo);	// on the heap
+    return track_outq_msg (lane);
+}
+
+Msg& AppL::create_msg (Msg::Link l, methodid_t mid, Msg::Body&& body, Msg::fdoffset_t fdo, extid_t extid)
+{
+    create_method_dest (mid,l);
+    auto lane = lane_of (mid);
+    _outq[lane].emplace_back (l,mid,move(body),fdo,extid);
+    return track_outq_msg (lane);
+}
+
+void AppL::requeue_msg (Msg&& msg)
+{
+    auto lane = lane_of (msg.method());
+    _outq[lane].emplace_back (move(msg));
+    track_outq_msg (lane);
+}
+
 void AppL::init (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]])
 {
     #ifndef NDEBUG
@@ -222,6 +573,13 @@ void AppL::init (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]])
 		set_flag (f_DebugMsgTrace);
 	optind = 1;
     #endif
+    // The binary trace works in release builds. The variable is removed,
+    // so launched servers do not overwrite the trace file.
+    if (auto tracefile = getenv ("CWICLO_MSG_TRACE"); tracefile) {
+	if (!_trace.open (tracefile))
+	    error_libc ("open message trace");
+	unsetenv ("CWICLO_MSG_TRACE");
+    }
 }
 
 void AppL::errorv (const char* fmt, va_list args)
@@ -0,0 +1,45 @@
+################ Source files ##########################################
+
+bench/srcs	:= $(wildcard bench/*.cc)
+bench/bsrcs	:= $(wildcard bench/?????.cc)
+bench/benches	:= $(addprefix $O,$(bench/bsrcs:.cc=))
+bench/objs	:= $(addprefix $O,$(bench/srcs:.cc=.o))
+bench/deps	:= ${bench/objs:.o=.d}
+
+################ Compilation ###########################################
+
+.PHONY:	bench/all bench bench/run bench/clean
+
+bench/all:	${bench/benches}
+
+# Benchmarks print timings, which are not compared to anything
+#
+bench:		bench/run
+bench/run:	${bench/benches}
+	@for i in ${bench/benches}; do \
+	    echo "Running bench/$$(basename $$i)";\
+	    PATH="${builddir}/bench" $$i;\
+	done
+
+$Obench/ipcpp $Obench/ipcrg $Obench/ipcth:	| $Obench/ipcppsrv
+
+${bench/benches}: $Obench/%: $Obench/%.o ${liba}
+	@echo "Linking $@ ..."
+	@${CC} ${ldflags} -o $@ $^
+
+$Obench/ipcppsrv:	$Obench/ipcppsrv.o ${liba}
+	@echo "Linking $@ ..."
+	@${CC} ${ldflags} -o $@ $^
+
+################ Maintenance ###########################################
+
+clean:	bench/clean
+bench/clean:
+	@if [ -d ${builddir}/bench ]; then\
+	    rm -f ${bench/benches} $Obench/ipcppsrv ${bench/objs} ${bench/deps} $Obench/.d;\
+	    rmdir ${builddir}/bench;\
+	fi
+
+${bench/objs}: Makefile bench/Module.mk ${confs} | $Obench/.d
+
+-include ${bench/deps}
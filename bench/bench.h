@@ -0,0 +1,74 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "../app.h"
+#include <time.h>
+using namespace cwiclo;
+
+//----------------------------------------------------------------------
+// Benchmarks print their timings and are not checked by make check.
+// Run them with make bench. Because the message loop backend is chosen
+// at configure time, compare backends by configuring with --with-uring,
+// --without-epoll, etc., and rerunning.
+
+class BenchTimer {
+public:
+		BenchTimer (void)	: _start (now()) {}
+    void	restart (void)		{ _start = now(); }
+    double	elapsed (void) const	{ return now() - _start; }
+    void	report (const char* what, unsigned n) const {
+		    auto t = elapsed();
+		    printf ("%-24s %8u in %7.3f s, %8.3f us each, %10.0f/s\n", what, n, t, t*1e6/n, n/t);
+		    fflush (stdout);
+		}
+    static double now (void) {
+		    struct timespec t;
+		    clock_gettime (CLOCK_MONOTONIC, &t);
+		    return t.tv_sec + t.tv_nsec*1e-9;
+		}
+private:
+    double	_start;
+};
+
+//----------------------------------------------------------------------
+// Echo is the interface for the IPC benchmarks, exported by ipcppsrv.
+// Unlike the test Ping, it does not log anything, keeping the timings
+// free of terminal output.
+
+class IEcho : public Interface {
+    DECLARE_INTERFACE_E (Interface, Echo, (echo,"u"), "@~cwiclo/bench/echo.socket", "ipcppsrv");
+public:
+    explicit	IEcho (mrid_t caller)	: Interface (caller) {}
+    void	echo (uint32_t v) const	{ send (m_echo(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_echo())
+	    return Interface::dispatch (o, msg);
+	o->Echo_echo (msg.read().read<uint32_t>());
+	return true;
+    }
+public:
+    class Reply : public Interface::Reply {
+    public:
+	constexpr	Reply (Msg::Link l)	: Interface::Reply (l) {}
+	void		echo (uint32_t v) const	{ send (m_echo(), v); }
+
+	template <typename O>
+	inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	    if (msg.method() != m_echo())
+		return Interface::Reply::dispatch (o, msg);
+	    o->Echo_echo (msg.read().read<uint32_t>());
+	    return true;
+	}
+    };
+};
+
+class EchoMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IEcho),)
+public:
+    explicit	EchoMsger (Msg::Link l)		: Msger(l) {}
+    void	Echo_echo (uint32_t v) const	{ reply<IEcho>().echo (v); }
+};
@@ -0,0 +1,120 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "bench.h"
+
+//----------------------------------------------------------------------
+// dspch measures the cost of Msger::dispatch for a Msger implementing
+// six interfaces of ten methods each. The IMPLEMENT_INTERFACES version
+// skips interfaces not containing the method; the chained version
+// calls each interface's dispatch in turn, as the macro used to.
+
+#define BENCH_INTERFACE_DISPATCH_METHOD(n,m)	\
+	if (msg.method() == m_m##m()) return o->Bench_call (n, m, msg.read().read<uint32_t>());
+
+#define BENCH_INTERFACE(n)	\
+class IBench##n : public Interface {\
+    DECLARE_INTERFACE (Interface, Bench##n, (m0,"u")(m1,"u")(m2,"u")(m3,"u")(m4,"u")(m5,"u")(m6,"u")(m7,"u")(m8,"u")(m9,"u"))\
+public:\
+    static constexpr methodid_t method (unsigned m) {\
+	constexpr const methodid_t c_methods[] = { m_m0(), m_m1(), m_m2(), m_m3(), m_m4(), m_m5(), m_m6(), m_m7(), m_m8(), m_m9() };\
+	return c_methods[m];\
+    }\
+    template <typename O>\
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {\
+	BENCH_INTERFACE_DISPATCH_METHOD(n,0) BENCH_INTERFACE_DISPATCH_METHOD(n,1)\
+	BENCH_INTERFACE_DISPATCH_METHOD(n,2) BENCH_INTERFACE_DISPATCH_METHOD(n,3)\
+	BENCH_INTERFACE_DISPATCH_METHOD(n,4) BENCH_INTERFACE_DISPATCH_METHOD(n,5)\
+	BENCH_INTERFACE_DISPATCH_METHOD(n,6) BENCH_INTERFACE_DISPATCH_METHOD(n,7)\
+	BENCH_INTERFACE_DISPATCH_METHOD(n,8) BENCH_INTERFACE_DISPATCH_METHOD(n,9)\
+	return Interface::dispatch (o, msg);\
+    }\
+};
+
+BENCH_INTERFACE(0)
+BENCH_INTERFACE(1)
+BENCH_INTERFACE(2)
+BENCH_INTERFACE(3)
+BENCH_INTERFACE(4)
+BENCH_INTERFACE(5)
+
+enum { NInterfaces = 6, NMethods = 10, NCalls = 20000000 };
+
+class GuardedMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IBench0)(IBench1)(IBench2)(IBench3)(IBench4)(IBench5),)
+public:
+    explicit	GuardedMsger (Msg::Link l)	: Msger(l),_sum(0) {}
+    bool	Bench_call (unsigned i, unsigned m, uint32_t v)
+		    { _sum += i*NMethods+m+v; return true; }
+    auto	sum (void) const		{ return _sum; }
+private:
+    uint64_t	_sum;
+};
+
+class ChainedMsger : public Msger {
+public:
+    explicit	ChainedMsger (Msg::Link l)	: Msger(l),_sum(0) {}
+    bool	dispatch (Msg& msg) override {
+		    return IBench0::dispatch (this, msg) || IBench1::dispatch (this, msg)
+			|| IBench2::dispatch (this, msg) || IBench3::dispatch (this, msg)
+			|| IBench4::dispatch (this, msg) || IBench5::dispatch (this, msg)
+			|| Msger::dispatch (msg);
+		}
+    bool	Bench_call (unsigned i, unsigned m, uint32_t v)
+		    { _sum += i*NMethods+m+v; return true; }
+    auto	sum (void) const		{ return _sum; }
+private:
+    uint64_t	_sum;
+};
+
+class BenchApp : public AppL {
+public:
+    static auto&	instance (void) { static BenchApp s_app; return s_app; }
+private:
+			BenchApp (void);
+    template <typename M>
+    static void		run_bench (const char* what, Msg* msgs, unsigned nmsgs);
+};
+
+template <typename M>
+void BenchApp::run_bench (const char* what, Msg* msgs, unsigned nmsgs) // static
+{
+    // Dispatched directly, to exclude the message loop
+    M m (Msg::Link { mrid_App, mrid_App });
+    Msger& mb = m;
+    BenchTimer timer;
+    for (auto i = 0u; i < NCalls; ++i)
+	mb.dispatch (msgs[i%nmsgs]);
+    timer.report (what, NCalls);
+    if (m.sum() == 42)	// prevents eliminating the calls
+	printf ("\n");
+}
+
+BenchApp::BenchApp (void)
+: AppL()
+{
+    auto method = [](unsigned i, unsigned m) {
+	constexpr methodid_t (*c_ifaces[])(unsigned) = { IBench0::method, IBench1::method, IBench2::method, IBench3::method, IBench4::method, IBench5::method };
+	return c_ifaces[i](m);
+    };
+    auto make_msg = [](methodid_t mid) {
+	Msg msg (Msg::Link { mrid_App, mrid_App }, mid, sizeof(uint32_t));
+	msg.write() << uint32_t(1);
+	return msg;
+    };
+    Msg last[] = { make_msg (method (NInterfaces-1, NMethods-1)) };
+    run_bench<ChainedMsger> ("Chained, last method", last, size(last));
+    run_bench<GuardedMsger> ("Guarded, last method", last, size(last));
+
+    vector<Msg> all;
+    for (auto i = 0u; i < NInterfaces; ++i)
+	for (auto m = 0u; m < NMethods; ++m)
+	    all.emplace_back (make_msg (method (i, m)));
+    run_bench<ChainedMsger> ("Chained, all methods", all.data(), all.size());
+    run_bench<GuardedMsger> ("Guarded, all methods", all.data(), all.size());
+    quit();
+}
+
+CWICLO_APP_L (BenchApp,)
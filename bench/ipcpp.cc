@@ -0,0 +1,71 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "bench.h"
+#include "../xtern.h"
+
+//----------------------------------------------------------------------
+// ipcpp measures message round trips to ipcppsrv. The first run sends
+// the next message only after receiving the reply to the previous one,
+// measuring latency. The second keeps a window of messages in flight,
+// measuring throughput when the socket traffic is batched. ipcrg
+// builds it with IPCPP_RINGS, to use the shared memory rings instead.
+
+#ifndef IPCPP_RINGS
+    #define IPCPP_RINGS	0
+#endif
+
+class BenchApp : public App {
+    IMPLEMENT_INTERFACES (App,,(IEcho))
+public:
+    enum : uint32_t {
+	NRoundTrips	= 20000,
+	NPipelined	= 200000,
+	Window		= 64
+    };
+public:
+    static auto&	instance (void) { static BenchApp s_app; return s_app; }
+    void		Echo_echo (uint32_t v);
+private:
+			BenchApp (void);
+private:
+    IEcho		_echo;
+    BenchTimer		_timer;
+    uint32_t		_nsent;
+    uint32_t		_nrecvd;
+    uint32_t		_window;
+};
+
+BenchApp::BenchApp (void)
+: App()
+,_echo (mrid_App)
+,_timer()
+,_nsent (1)
+,_nrecvd (0)
+,_window (1)
+{
+    set_extern_rings (IPCPP_RINGS);
+    _echo.echo (0);
+}
+
+void BenchApp::Echo_echo (uint32_t)
+{
+    if (++_nrecvd == 1 && _window == 1)
+	_timer.restart();	// exclude connection setup
+    else if (_window == 1 && _nrecvd == NRoundTrips+1) {
+	_timer.report ("round trips", NRoundTrips);
+	_window = Window;
+	_nsent = _nrecvd = 0;
+	_timer.restart();
+    } else if (_window > 1 && _nrecvd == NPipelined) {
+	_timer.report ("pipelined round trips", NPipelined);
+	return quit();
+    }
+    auto nmax = _window == 1 ? NRoundTrips+1 : NPipelined;
+    while (_nsent < nmax && _nsent - _nrecvd < _window)
+	_echo.echo (_nsent++);
+}
+
+CWICLO_APP (BenchApp,,(IEcho),)
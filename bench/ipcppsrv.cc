@@ -0,0 +1,19 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "bench.h"
+#include "../xtern.h"
+
+//----------------------------------------------------------------------
+// ipcppsrv exports the Echo interface for the ipcpp and ipcrg benchmarks,
+// offering the shared memory rings, which only ipcrg accepts.
+
+class BenchApp : public App {
+			BenchApp (void) : App() { set_extern_rings(); }
+public:
+    static auto&	instance (void) { static BenchApp s_app; return s_app; }
+};
+
+CWICLO_APP (BenchApp, (EchoMsger),,(IEcho))
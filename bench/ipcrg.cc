@@ -0,0 +1,11 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+//----------------------------------------------------------------------
+// ipcrg is ipcpp with the connection to ipcppsrv using the shared memory
+// rings, for comparing the two transports.
+
+#define IPCPP_RINGS	1
+#include "ipcpp.cc"
@@ -0,0 +1,68 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "bench.h"
+#include "../xtern.h"
+
+//----------------------------------------------------------------------
+// ipcth measures the throughput of small messages to ipcppsrv, sending
+// them in bursts without waiting for replies, and the next burst when
+// all the replies arrive. The replies come as fast as ipcppsrv writes
+// them, and are read several at a time, so the recvmsg calls made to
+// read them are reported per message.
+
+class BenchApp : public App {
+    IMPLEMENT_INTERFACES (App,,(IEcho))
+public:
+    enum : uint32_t {
+	NBursts		= 200,
+	BurstSize	= 1000
+    };
+public:
+    static auto&	instance (void) { static BenchApp s_app; return s_app; }
+    void		Echo_echo (uint32_t v);
+private:
+			BenchApp (void);
+    const Extern*	connection (void)	{ return create_extern_dest_for (IEcho::interface()); }
+private:
+    IEcho		_echo;
+    BenchTimer		_timer;
+    uint32_t		_nrecvd;
+    uint32_t		_nreads;
+    uint32_t		_nreceived;
+};
+
+BenchApp::BenchApp (void)
+: App()
+,_echo (mrid_App)
+,_timer()
+,_nrecvd (0)
+,_nreads (0)
+,_nreceived (0)
+{
+    _echo.echo (0);	// connects before timing
+}
+
+void BenchApp::Echo_echo (uint32_t)
+{
+    auto e = connection();
+    if (!e)
+	return quit();
+    if (!_nrecvd++) {
+	_nreads = e->info().nreads;
+	_nreceived = e->info().nreceived;
+	_timer.restart();
+    } else if (_nrecvd > NBursts*BurstSize) {
+	_timer.report ("messages in bursts", NBursts*BurstSize);
+	auto nreads = e->info().nreads - _nreads, nreceived = e->info().nreceived - _nreceived;
+	printf ("%-24s %8u for %8u messages, %8.3f each\n", "recvmsg calls", nreads, nreceived, double(nreads)/nreceived);
+	return quit();
+    }
+    if (_nrecvd % BurstSize == 1)
+	for (auto i = 0u; i < BurstSize; ++i)
+	    _echo.echo (i);
+}
+
+CWICLO_APP (BenchApp,,(IEcho),)
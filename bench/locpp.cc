@@ -0,0 +1,134 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "bench.h"
+
+//----------------------------------------------------------------------
+// locpp measures local message throughput, with messages bounced off
+// a Msger in the same process, keeping a window of them in flight.
+// The Echo interface carries a small body, the Text interface one
+// of a hundred bytes. Heap allocations made during each run are
+// counted by wrapping the glibc realloc and free, which cwiclo uses.
+
+extern "C" void* __libc_realloc (void* p, size_t n) noexcept;
+extern "C" void __libc_free (void* p) noexcept;
+
+static unsigned s_nreallocs = 0, s_nfrees = 0;
+
+extern "C" void* realloc (void* p, size_t n) noexcept
+    { ++s_nreallocs; return __libc_realloc (p, n); }
+extern "C" void free (void* p) noexcept
+    { s_nfrees += !!p; __libc_free (p); }
+
+class IText : public Interface {
+    DECLARE_INTERFACE (Interface, Text, (text,"s"))
+public:
+    explicit	IText (mrid_t caller)		: Interface (caller) {}
+    void	text (const string_view& s) const	{ send (m_text(), s); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_text())
+	    return Interface::dispatch (o, msg);
+	o->Text_text (msg.read().read<string_view>());
+	return true;
+    }
+public:
+    class Reply : public Interface::Reply {
+    public:
+	constexpr	Reply (Msg::Link l)		: Interface::Reply (l) {}
+	void		text (const string_view& s) const	{ send (m_text(), s); }
+
+	template <typename O>
+	inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	    if (msg.method() != m_text())
+		return Interface::Reply::dispatch (o, msg);
+	    o->Text_text (msg.read().read<string_view>());
+	    return true;
+	}
+    };
+};
+
+class TextMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IText),)
+public:
+    explicit	TextMsger (Msg::Link l)		: Msger(l) {}
+    void	Text_text (const string_view& s) const	{ reply<IText>().text (s); }
+};
+
+class BenchApp : public AppL {
+    IMPLEMENT_INTERFACES (AppL,,(IEcho)(IText))
+public:
+    enum : uint32_t {
+	NEchoes	= 2000000,
+	NTexts	= 1000000,
+	Window	= 64
+    };
+public:
+    static auto&	instance (void) { static BenchApp s_app; return s_app; }
+    void		Echo_echo (uint32_t v);
+    void		Text_text (const string_view& s);
+private:
+			BenchApp (void);
+    bool		bounce (uint32_t n, const char* what);
+private:
+    IEcho		_echo;
+    IText		_text;
+    BenchTimer		_timer;
+    uint32_t		_nsent;
+    uint32_t		_nrecvd;
+    char		_textbuf [100];
+};
+
+BenchApp::BenchApp (void)
+: AppL()
+,_echo (mrid_App)
+,_text (mrid_App)
+,_timer()
+,_nsent (0)
+,_nrecvd (0)
+,_textbuf{}
+{
+    fill_n (begin(_textbuf), size(_textbuf)-1, 'x');
+    for (; _nsent < Window; ++_nsent)
+	_echo.echo (_nsent);
+}
+
+// Returns true if another message is to be sent. When all n are
+// received, the counters are reset for the next run.
+bool BenchApp::bounce (uint32_t n, const char* what)
+{
+    if (++_nrecvd == n) {
+	_timer.report (what, n);
+	printf ("%24s %8u reallocs, %u frees\n", "", s_nreallocs, s_nfrees);
+	_nsent = _nrecvd = 0;
+	s_nreallocs = s_nfrees = 0;
+	_timer.restart();
+	return false;
+    }
+    if (_nsent >= n)
+	return false;
+    ++_nsent;
+    return true;
+}
+
+void BenchApp::Echo_echo (uint32_t v)
+{
+    if (bounce (NEchoes, "local small round trips"))
+	_echo.echo (v);
+    else if (!_nrecvd)	// start the text run
+	for (; _nsent < Window; ++_nsent)
+	    _text.text (_textbuf);
+}
+
+void BenchApp::Text_text (const string_view& s)
+{
+    if (bounce (NTexts, "local 100 byte round trips"))
+	_text.text (s);
+    else if (!_nrecvd)
+	quit();
+}
+
+CWICLO_APP_L (BenchApp, (EchoMsger)(TextMsger))
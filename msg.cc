@@ -33,13 +33,42 @@ Msg::Msg (const Link& l, methodid_t mid, streamsize size, fdoffset_t fdo)
 ,_link (l)
 ,_extid (0)
 ,_fdoffset (fdo)
-,_body (ceilg (size, Alignment::Body))
+,_body()
 {
+    if (size && size <= MaxInlineSize) {
+	_body.link (Body::pointer(nullptr), size);	// null data marks the body as inline
+	zero_fill (_ibody);		// and zeroes the alignment padding
+	return;
+    }
+    _body.resize (ceilg (size, Alignment::Body));
     auto ppade = _body.end();
     _body.shrink (size);
     zero_fill (_body.end(), ppade);	// zero out the alignment padding
 }
 
+// Copies an inline or linked body into its own block,
+// keeping the zeroed alignment padding after it.
+void Msg::detach_body (void)
+{
+    auto sz = size();
+    Body b (ceilg (sz, Alignment::Body));
+    copy_n (data(), b.size(), b.data());
+    b.shrink (sz);
+    _body = move(b);
+}
+
+void Msg::resize_body (streamsize sz)
+{
+    if (is_body_inline() && sz && sz <= MaxInlineSize) {
+	zero_fill_n (_ibody+sz, MaxInlineSize-sz);
+	_body.link (Body::pointer(nullptr), sz);
+    } else {
+	if (_body.is_linked())
+	    detach_body();
+	_body.resize (sz);
+    }
+}
+
 static streamsize sigelement_size (char c)
 {
     static const struct { char sym; uint8_t sz; } syms[] = {
@@ -170,6 +199,20 @@ static streamsize validate_sigelement (istream& is, const char*& sig)
     return sz;
 }
 
+// A message passes an fd for each h in its signature. They must be
+// consecutive in the body, starting at fd_offset. Arrays of fds are
+// not passed.
+unsigned Msg::fd_count (const char* sig) // static
+{
+    unsigned n = 0;
+    while (*sig)
+	n += (*sig++ == 'h');
+    return n;
+}
+
+unsigned Msg::fd_count (void) const
+    { return fd_offset() == NoFdIncluded ? 0 : fd_count (signature()); }
+
 streamsize Msg::validate_signature (istream is, const char* sig) // static
 {
     streamsize sz = 0;
@@ -191,6 +234,11 @@ Msg& IDispatch::create_msg (methodid_t mid, streamsize sz) const
 Msg& IDispatch::create_msg (methodid_t imethod, Msg::Body&& body, Msg::fdoffset_t fdo, extid_t extid) const
     { return AppL::instance().create_msg (link(), imethod, move(body), fdo, extid); }
 
+// When true, the sender should stop sending to dest until notified
+// with Msger::on_dest_drained.
+bool IDispatch::dest_backlogged (void) const
+    { return AppL::instance().is_backlogged (link()); }
+
 Msg* IDispatch::get_outgoing_msg (methodid_t imethod) const
     { return AppL::instance().has_outq_msg (imethod, link()); }
 
@@ -241,6 +289,12 @@ Msger::Msger (void)
 {
 }
 
+// The App deletes only the Msgers listed here
+void Msger::flag_unused (void)
+{
+    AppL::instance().add_unused_msger (msger_id());
+}
+
 void Msger::error (const char* fmt, ...) // static
 {
     va_list args;
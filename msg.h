@@ -58,21 +58,37 @@ using iid_t = const char*;
 //
 using methodid_t = const char*;
 
-// Methods are preceded by indexes to interface and next method
+// Messages of each interface are queued in one of these lanes, with
+// higher lanes dispatched first. High is for control messages, like
+// cancellation, that should not wait behind bulk data in Low. Since
+// messages in different lanes are reordered, an interface should get
+// its own lane only if it does not depend on the order of messages
+// sent with other interfaces.
+//
+enum class Priority : uint8_t { Low, Normal, High };
+enum { NPriorities = uint8_t(Priority::High)+1 };
+
+// Methods are preceded by the interface priority and the offset to
+// the next method, so that the lane of a message is found directly.
 static constexpr auto method_next_offset (methodid_t mid)
     { return uint8_t(mid[-1]); }
 static constexpr auto method_name_size (methodid_t mid)
-    { return method_next_offset(mid)-1; }
+    { return method_next_offset(mid)-2; }
+static constexpr auto priority_of_method (methodid_t mid)
+    { return Priority (mid[-2]); }
 
 // Signatures immediately follow the method in the pack
 static constexpr const char* signature_of_method (methodid_t __restrict__ mid)
     { return zstr::next(mid); }
 
-// Interface name and methods are packed together for easy lookup
+// Interface name and methods are packed together for easy lookup.
+// The name is likewise preceded by the priority and its size.
 static constexpr auto interface_name_size (iid_t iid)
     { return uint8_t(iid[-1]); }
+static constexpr auto interface_priority (iid_t iid)
+    { return Priority (iid[-2]); }
 static constexpr methodid_t interface_first_method (iid_t iid)
-    { return iid+interface_name_size(iid)+1; }
+    { return iid+interface_name_size(iid)+2; }
 static constexpr iid_t interface_of_method (methodid_t __restrict__ mid) {
     for (uint8_t nextm = 0; (nextm = method_next_offset(mid)); mid += nextm) {}
     #if __x86__
@@ -83,12 +99,13 @@ static constexpr iid_t interface_of_method (methodid_t __restrict__ mid) {
 }
 
 // Socket name and default program are at the end of the interface block
-static constexpr auto interface_socket_name (iid_t iid)
+static constexpr auto interface_block_end (methodid_t __restrict__ mid)
 {
-    methodid_t __restrict__ i = interface_first_method (iid);
-    for (uint8_t nextm = 0; (nextm = method_next_offset (i)); i += nextm) {}
-    return i+2;
+    for (uint8_t nextm = 0; (nextm = method_next_offset (mid)); mid += nextm) {}
+    return mid+2;
 }
+static constexpr auto interface_socket_name (iid_t iid)
+    { return interface_block_end (interface_first_method (iid)); }
 static constexpr auto interface_program_name (iid_t iid)
     { return zstr::next (interface_socket_name (iid)); }
 
@@ -108,12 +125,15 @@ methodid_t interface_lookup_method (iid_t iid, const char* __restrict__ mname, s
 // sequence with each element delimited by parentheses (a)(b)(c).
 
 #define DECLARE_INTERFACE_METHOD_VARS(iface,mname,sig)	\
+	Priority method_##mname##_priority;		\
 	uint8_t	method_##mname##_size;			\
 	char	method_##mname [sizeof(#mname)];	\
 	char	method_##mname##_signature [sizeof(sig)];
 
 #define DEFINE_INTERFACE_METHOD_VALUES(iface,mname,sig)	\
-    sizeof(D##iface::method_##mname##_size)+		\
+    D##iface::c_priority,				\
+    sizeof(D##iface::method_##mname##_priority)+	\
+	sizeof(D##iface::method_##mname##_size)+	\
 	sizeof(D##iface::method_##mname)+		\
 	sizeof(D##iface::method_##mname##_signature),	\
     #mname, sig,
@@ -124,15 +144,18 @@ methodid_t interface_lookup_method (iid_t iid, const char* __restrict__ mname, s
 
 // This creates an interface definition variable as a static string
 // block containing the name followed by method\0signature pairs.
-// method names are preceded by size and offset bytes to allow
-// obtaining interface name directly from the method name and to
-// speed up lookup of method by name.
+// method names are preceded by priority, size, and offset bytes to
+// allow obtaining the lane and interface name directly from the method
+// name and to speed up lookup of method by name.
 //
-#define DECLARE_INTERFACE_E(base,iface,methods,socket,prog)\
+#define DECLARE_INTERFACE_EP(base,iface,methods,socket,prog,prio)\
     struct D##iface {			\
+	static constexpr Priority c_priority = Priority::prio;\
+	Priority priority;		\
 	uint8_t	name_size;		\
 	char	name [sizeof(#iface)];	\
 	SEQ_FOR_EACH (methods, iface, DECLARE_INTERFACE_METHOD_VARS)\
+	Priority endpriority;		\
 	uint8_t	endzero;		\
 	uint8_t name_offset_low;	\
 	uint8_t name_offset_high;	\
@@ -140,22 +163,33 @@ methodid_t interface_lookup_method (iid_t iid, const char* __restrict__ mname, s
 	char	program_name [sizeof(prog)];\
     };					\
     static constexpr const D##iface i_##iface = {\
-	sizeof(#iface), #iface,		\
+	D##iface::c_priority, sizeof(#iface), #iface,\
 	SEQ_FOR_EACH (methods, iface, DEFINE_INTERFACE_METHOD_VALUES)\
-	0,				\
+	D##iface::c_priority, 0,	\
 	uint8_t(offsetof(D##iface, name_offset_low)-offsetof(D##iface, name)),\
 	uint8_t((offsetof(D##iface, name_offset_low)-offsetof(D##iface, name))>>8),\
-	socket, prog\
+	socket, prog			\
     };					\
     SEQ_FOR_EACH (methods, iface, DECLARE_INTERFACE_METHOD_ACCESSORS)\
 public:					\
     using base_class_t = base;		\
     static constexpr iid_t interface (void) { return i_##iface.name; }\
+    static constexpr auto interface_priority (void) { return i_##iface.priority; }\
     static constexpr auto interface_socket (void) { return i_##iface.socket_name; }\
     static constexpr auto interface_program (void) { return i_##iface.program_name; }\
     static constexpr auto n_interfaces (void) { return base_class_t::n_interfaces()+1; }\
     static constexpr auto get_interfaces (iid_t* i)\
-	{ i = base_class_t::get_interfaces(i); *i++ = interface(); return i; }
+	{ i = base_class_t::get_interfaces(i); *i++ = interface(); return i; }\
+    static bool has_method (methodid_t mid) {\
+	return uintptr_t(mid) - uintptr_t(interface()) < offsetof(D##iface,endzero)-offsetof(D##iface,name)\
+		|| base_class_t::has_method (mid);\
+    }
+
+// Interfaces are in the Normal lane unless declared otherwise
+#define DECLARE_INTERFACE_E(base,iface,methods,socket,prog)\
+    DECLARE_INTERFACE_EP(base,iface,methods,socket,prog,Normal)
+#define DECLARE_INTERFACE_P(base,iface,methods,prio)\
+    DECLARE_INTERFACE_EP(base,iface,methods,"","",prio)
 
 // The common case for socket-less interfaces
 #define DECLARE_INTERFACE(base,iface,methods) DECLARE_INTERFACE_E(base,iface,methods,"","")
@@ -188,28 +222,32 @@ public:
 	static constexpr streamsize Body = Header;
 	static constexpr streamsize Fd = alignof(fd_t);
     };
-    enum { MaxSize = (1u<<24)-1 };
+    enum { MaxSize = (1u<<24)-1, MaxInlineSize = 32 };
 public:
 			Msg (const Link& l, methodid_t mid, streamsize size, fdoffset_t fdo = NoFdIncluded);
     constexpr auto&	link (void) const	{ return _link; }
     constexpr auto	src (void) const	{ return _link.src; }
     constexpr auto	dest (void) const	{ return _link.dest; }
     constexpr auto	size (void) const	{ return _body.size(); }
+    constexpr auto	body_capacity (void) const { return _body.capacity(); }
     constexpr auto	max_size (void) const	{ return MaxSize; }
-    constexpr auto	data (void) const	{ return assume_aligned (_body.data(),16); }
-    constexpr auto	data (void)		{ return assume_aligned (_body.data(),16); }
-    constexpr auto	begin (void) const	{ return assume_aligned (_body.begin(),16); }
-    constexpr auto	begin (void)		{ return assume_aligned (_body.begin(),16); }
-    constexpr auto	end (void) const	{ return _body.end(); }
-    constexpr auto	end (void)		{ return _body.end(); }
+    constexpr bool	is_body_inline (void) const { return !_body.data() && _body.size(); }
+    constexpr const_iterator data (void) const	{ return assume_aligned (_body.data() ? _body.data() : _ibody,16); }
+    constexpr iterator	data (void)		{ return assume_aligned (_body.data() ? _body.data() : _ibody,16); }
+    constexpr auto	begin (void) const	{ return data(); }
+    constexpr auto	begin (void)		{ return data(); }
+    constexpr auto	end (void) const	{ return begin()+size(); }
+    constexpr auto	end (void)		{ return begin()+size(); }
     constexpr auto	method (void) const	{ return _method; }
     constexpr auto	interface (void) const	{ return interface_of_method (method()); }
     constexpr auto	signature (void) const	{ return signature_of_method (method()); }
     constexpr auto	extid (void) const	{ return _extid; }
     constexpr auto	fd_offset (void) const	{ return _fdoffset; }
-    constexpr auto&&	move_body (void)	{ return move(_body); }
-    constexpr void	wipe_body (void)	{ _body.wipe(); }
-    void		resize_body (streamsize sz) { _body.resize (sz); }
+    unsigned		fd_count (void) const;
+    static unsigned	fd_count (const char* sig);
+    constexpr auto&&	move_body (void)	{ if (_body.is_linked() && size()) detach_body(); return move(_body); } // inline and arena bodies must not escape
+    constexpr void	wipe_body (void)	{ _body.wipe(); zero_fill (_ibody); }
+    void		resize_body (streamsize sz);
     void		replace_body (Body&& b)	{ _body = move(b); }
     inline constexpr auto read (void) const	{ return istream (data(),size()); }
     inline constexpr auto write (void)		{ return ostream (data(),size()); }
@@ -220,15 +258,25 @@ public:
     inline constexpr	Msg (const Link& l, methodid_t mid, Body&& body, fdoffset_t fdo = NoFdIncluded, extid_t extid = 0)
 			    :_method (mid),_link (l),_extid (extid),_fdoffset (fdo),_body (move (body)) {}
     inline constexpr	Msg (Msg&& msg)
-			    : Msg (msg.link(), msg.method(), msg.move_body(), msg.fd_offset(), msg.extid()) {}
+			    :_method (msg.method()),_link (msg.link()),_extid (msg.extid()),_fdoffset (msg.fd_offset()),_body() {
+				if (!msg.is_body_inline())
+				    _body = msg.move_body();
+				else {	// inline bodies are copied, having no block to move
+				    copy (msg._ibody, _ibody);
+				    _body.link (Body::pointer(nullptr), exchange (msg._body, Body()).size());
+				}
+			    }
 			Msg (const Msg&) = delete;
     Msg&		operator= (const Msg&) = delete;
+private:
+    void		detach_body (void);
 private:
     methodid_t		_method;
     Link		_link;
     extid_t		_extid;
     fdoffset_t		_fdoffset;
-    Body		_body;
+    Body		_body;	// with null data, the body is in _ibody
+    alignas(16) value_type _ibody [MaxInlineSize];
 };
 
 //}}}-------------------------------------------------------------------
@@ -244,6 +292,7 @@ public:
     constexpr auto&	link (void) const	{ return _link; }
     constexpr auto	src (void) const	{ return link().src; }
     constexpr auto	dest (void) const	{ return link().dest; }
+    bool		dest_backlogged (void) const;
 protected:
     constexpr		IDispatch (mrid_t from, mrid_t to) : _link {from,to} {}
     constexpr		IDispatch (Msg::Link l)	: _link (Msg::Link::reverse(l)) {}
@@ -269,10 +318,14 @@ protected:
 			    auto& msg = create_msg (imethod, variadic_stream_sizeof(args...));
 			    commit_msg (msg, (msg.write() << ... << args));
 			}
-    void		send_fd (methodid_t imethod, fd_t fd) const {
-			    assert (string_view("h") == signature_of_method(imethod));
-			    auto& msg = create_msg (imethod, stream_sizeof(fd), 0);
-			    commit_msg (msg, msg.write() << fd);
+    void		send_fd (methodid_t imethod, fd_t fd) const
+			    { send_fds (imethod, fd); }
+    template <typename... Fds>
+    void		send_fds (methodid_t imethod, Fds... fds) const {
+			    [[maybe_unused]] auto sig = signature_of_method (imethod);
+			    assert (zstr::length(sig) == sizeof...(fds) && Msg::fd_count(sig) == sizeof...(fds) && "send_fds signature must have an h for each fd, and nothing else");
+			    auto& msg = create_msg (imethod, sizeof...(fds)*sizeof(fd_t), 0);
+			    commit_msg (msg, (msg.write() << ... << fd_t(fds)));
 			}
     template <typename... Args>
     inline void		resend (methodid_t imethod, const Args&... args) const {
@@ -295,13 +348,19 @@ private:
 // are the services the Msger object provides. The second argument contains
 // the list of reply interfaces; these specify interfaces that the Msger
 // uses itself, receiving replies on them from other Msger objects.
+// Together with those of the base class, they make the null-terminated
+// list returned by dispatched_interfaces, used to deliver broadcasts
+// only to Msgers that can accept them. Msgers not using these macros
+// return nullptr from it, and receive all broadcasts.
 //
 
 //{{{2 IMPLEMENT_INTERFACES helper macros
+// Interface dispatch compares the method with each of its methods, so
+// it is skipped unless the method is in the interface's string block.
 #define GENERATE_CALL_N_INTERFACES(arg,iface) arg iface::n_interfaces()
 #define GENERATE_CALL_GET_INTERFACES(arg,iface) arg = iface::get_interfaces(arg);
-#define GENERATE_CALL_DISPATCH_I_INTERFACES(o,iface) || iface::dispatch(o,msg)
-#define GENERATE_CALL_DISPATCH_R_INTERFACES(o,iface) || iface::Reply::dispatch(o,msg)
+#define GENERATE_CALL_DISPATCH_I_INTERFACES(o,iface) || (iface::has_method(msg.method()) && iface::dispatch(o,msg))
+#define GENERATE_CALL_DISPATCH_R_INTERFACES(o,iface) || (iface::has_method(msg.method()) && iface::Reply::dispatch(o,msg))
 #define IMPLEMENT_INTERFACES_I_M(base, invokable, reply)\
 public:\
     using base_class_t = base;\
@@ -309,6 +368,21 @@ public:\
 	{ return 0 SEQ_FOR_EACH (invokable,+,GENERATE_CALL_N_INTERFACES); }\
     static constexpr auto get_interfaces (iid_t* i)\
 	{ SEQ_FOR_EACH (invokable,i,GENERATE_CALL_GET_INTERFACES) return i; }\
+    static constexpr auto n_dispatched_interfaces (void)\
+	{ return base_class_t::n_dispatched_interfaces()\
+		SEQ_FOR_EACH (invokable,+,GENERATE_CALL_N_INTERFACES)\
+		SEQ_FOR_EACH (reply,+,GENERATE_CALL_N_INTERFACES); }\
+    static constexpr auto get_dispatched_interfaces (iid_t* i) {\
+	i = base_class_t::get_dispatched_interfaces(i);\
+	SEQ_FOR_EACH (invokable,i,GENERATE_CALL_GET_INTERFACES)\
+	SEQ_FOR_EACH (reply,i,GENERATE_CALL_GET_INTERFACES)\
+	return i;\
+    }\
+    const iid_t* dispatched_interfaces (void) const override {\
+	struct iids_t { iid_t v [n_dispatched_interfaces()+1]; };\
+	static constexpr auto s_iids = []{ iids_t r = {}; get_dispatched_interfaces (r.v); return r; }();\
+	return s_iids.v;\
+    }\
 protected:\
     template <typename M>\
     inline static constexpr bool dispatch_interfaces (M* o, Msg& msg)\
@@ -358,9 +432,13 @@ public:
     static void		error (const char* fmt, ...) PRINTFARGS(1,2);
     static void		error_libc (const char* f);
     virtual bool	dispatch (Msg&)			{ return false; }
+    virtual bool	dispatch_batch (Msg* f, Msg* l)	{ auto r = true; for (; f < l; ++f) r &= dispatch (*f); return r; }
+    virtual const iid_t* dispatched_interfaces (void) const { return nullptr; }
     virtual bool	on_error (mrid_t, const string&){ set_unused(); return false; }
     virtual void	on_msger_destroyed (mrid_t mid)
 			    { if (mid == creator_id()) { _link.src = msger_id(); set_unused(); } }
+    virtual bool	is_backlogged (void) const	{ return false; }
+    virtual void	on_dest_drained (mrid_t)	{ }
 protected:
     explicit constexpr	Msger (Msg::Link l)		:_link(l),_flags() {}
     explicit constexpr	Msger (mrid_t id)		:_link{mrid_App,id},_flags(bit_mask(f_Static)) {}
@@ -368,12 +446,17 @@ protected:
 			Msger (const Msger&) = delete;
     void		operator= (const Msger&) = delete;
     constexpr void	set_flag (unsigned f, bool v = true)	{ set_bit (_flags,f,v); }
-    constexpr void	set_unused (bool v = true)	{ set_flag (f_Unused, v); }
+    void		set_unused (bool v = true)
+			    { if (v && !flag (f_Unused)) flag_unused(); set_flag (f_Unused, v); }
     template <typename I>
     constexpr auto	reply (void) const		{ return typename I::Reply (creator_link()); }
 protected:
     static constexpr auto n_interfaces (void)		{ return 0; }
     static constexpr auto get_interfaces (iid_t* i)	{ return i; }
+    static constexpr auto n_dispatched_interfaces (void){ return 0; }
+    static constexpr auto get_dispatched_interfaces (iid_t* i) { return i; }
+private:
+    void		flag_unused (void);
 private:
     Msg::Link		_link;
     uint32_t		_flags;
@@ -410,6 +493,7 @@ protected:
 protected:
     static constexpr auto n_interfaces (void)		{ return 0; }
     static constexpr auto get_interfaces (iid_t* i)	{ return i; }
+    static constexpr bool has_method (methodid_t)	{ return false; }
 };
 
 } // namespace cwiclo
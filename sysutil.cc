@@ -13,6 +13,11 @@
     #include <arpa/inet.h>
 #endif
 #include <time.h>
+#include <sys/mman.h>
+#if USE_URING
+    #include <linux/io_uring.h>
+    #include <sys/syscall.h>
+#endif
 
 //{{{ File descriptor and path utilities -------------------------------
 namespace cwiclo {
@@ -347,6 +352,108 @@ const char* debug_socket_name (const struct sockaddr* addr)
     return s_snbuf;
 }
 
+//}}}-------------------------------------------------------------------
+//{{{ URing
+
+#if USE_URING
+
+bool URing::open (unsigned entries)
+{
+    assert (!is_open());
+    // Completions are only reaped by this thread, in submit_and_wait,
+    // so their processing can be deferred until then. (Since 6.1)
+    io_uring_params p = {};
+    p.flags = IORING_SETUP_SUBMIT_ALL| IORING_SETUP_COOP_TASKRUN| IORING_SETUP_SINGLE_ISSUER| IORING_SETUP_DEFER_TASKRUN;
+    int fd = syscall (__NR_io_uring_setup, entries, &p);
+    if (fd < 0 && errno == EINVAL) {
+	p = {};
+	fd = syscall (__NR_io_uring_setup, entries, &p);
+    }
+    if (fd < 0)
+	return false;
+    // A single ring mapping and the extended wait argument, carrying
+    // the signal mask and the timeout, are required. Both are in 5.11.
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+	::close (fd);
+	errno = ENOSYS;
+	return false;
+    }
+    _fd = fd;
+    _ringsz = max (p.sq_off.array + p.sq_entries*sizeof(uint32_t),
+		    p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe));
+    _sqesz = p.sq_entries*sizeof(io_uring_sqe);
+    auto ring = mmap (nullptr, _ringsz, PROT_READ| PROT_WRITE, MAP_SHARED| MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    auto sqes = mmap (nullptr, _sqesz, PROT_READ| PROT_WRITE, MAP_SHARED| MAP_POPULATE, _fd, IORING_OFF_SQES);
+    _ring = (ring == MAP_FAILED ? nullptr : ring);
+    _sqes = (sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes));
+    if (!_ring || !_sqes) {
+	close();
+	return false;
+    }
+    auto rp = static_cast<char*>(_ring);
+    _sqhead = pointer_cast<uint32_t>(rp + p.sq_off.head);
+    _sqtail = pointer_cast<uint32_t>(rp + p.sq_off.tail);
+    _sqmask = *pointer_cast<uint32_t>(rp + p.sq_off.ring_mask);
+    _cqhead = pointer_cast<uint32_t>(rp + p.cq_off.head);
+    _cqtail = pointer_cast<uint32_t>(rp + p.cq_off.tail);
+    _cqmask = *pointer_cast<uint32_t>(rp + p.cq_off.ring_mask);
+    _cqes = pointer_cast<io_uring_cqe>(rp + p.cq_off.cqes);
+    _sqlocaltail = *_sqtail;
+    // sqes are always used in ring order, so the index array is constant
+    auto sqarray = pointer_cast<uint32_t>(rp + p.sq_off.array);
+    for (auto i = 0u; i < p.sq_entries; ++i)
+	sqarray[i] = i;
+    return true;
+}
+
+io_uring_sqe* URing::get_sqe (void)
+{
+    assert (is_open());
+    // If the submission queue is full, submit it without waiting
+    if (_sqlocaltail - __atomic_load_n (_sqhead, int(memory_order::acquire)) > _sqmask)
+	submit_and_wait (0);
+    auto sqe = &_sqes [_sqlocaltail++ & _sqmask];
+    *sqe = {};
+    return sqe;
+}
+
+int URing::submit_and_wait (unsigned nwait, const timespec* ts, const sigset_t* sigmask)
+{
+    assert (is_open());
+    __atomic_store_n (_sqtail, _sqlocaltail, int(memory_order::release));
+    auto nsubmit = _sqlocaltail - __atomic_load_n (_sqhead, int(memory_order::acquire));
+    io_uring_getevents_arg arg = {};
+    arg.sigmask = uintptr_t(sigmask);
+    arg.sigmask_sz = _NSIG/8;
+    arg.ts = uintptr_t(ts);
+    return syscall (__NR_io_uring_enter, _fd, nsubmit, nwait,
+		    IORING_ENTER_EXT_ARG| IORING_ENTER_GETEVENTS, &arg, sizeof(arg));
+}
+
+const io_uring_cqe* URing::peek_cqe (void) const
+{
+    assert (is_open());
+    auto head = *_cqhead;
+    if (head == __atomic_load_n (_cqtail, int(memory_order::acquire)))
+	return nullptr;
+    return &_cqes [head & _cqmask];
+}
+
+void URing::pop_cqe (void)
+    { __atomic_store_n (_cqhead, *_cqhead+1, int(memory_order::release)); }
+
+#endif // USE_URING
+
+void URing::close (void)
+{
+    if (_sqes)
+	munmap (exchange (_sqes, nullptr), _sqesz);
+    if (_ring)
+	munmap (exchange (_ring, nullptr), _ringsz);
+    if (_fd >= 0)
+	::close (exchange (_fd, -1));
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ chrono
 
@@ -360,6 +467,14 @@ auto system_clock::now (void) -> rep
     return t.tv_nsec/1000000 + t.tv_sec*1000;
 }
 
+auto steady_clock::now (void) -> rep
+{
+    struct timespec t;
+    if (0 > clock_gettime (CLOCK_MONOTONIC, &t))
+	return 0;
+    return t.tv_nsec + t.tv_sec*rep(1000000000);
+}
+
 } // namespace chrono
 } // namespace cwiclo
 //}}}-------------------------------------------------------------------
@@ -6,10 +6,13 @@
 #pragma once
 #include "string.h"
 #include <sys/socket.h>
+#include <signal.h>
 
-//{{{ Socket prototypes ------------------------------------------------
+//{{{ Socket and io_uring prototypes -----------------------------------
 
 struct sockaddr_un;
+struct io_uring_sqe;
+struct io_uring_cqe;
 
 //}}}-------------------------------------------------------------------
 //{{{ EINTR-aware read and write
@@ -131,6 +134,46 @@ string substitute_environment_vars (const string_view& s);
 
 void srandrand (void);
 
+//}}}-------------------------------------------------------------------
+//{{{ URing
+
+// A minimal io_uring, set up with raw syscalls, since liburing is not
+// always installed. Available only when configured --with-uring.
+// AppL uses it only for fd poll requests and the wait; the I/O on
+// the ready fds is still done by the Msgers with ordinary syscalls.
+class URing {
+public:
+    enum { DefaultEntries = 64 };
+public:
+    constexpr		URing (void)
+			    :_sqhead(),_sqtail(),_cqhead(),_cqtail(),_sqes(),_cqes()
+			    ,_ring(),_ringsz(),_sqesz(),_sqmask(),_cqmask(),_sqlocaltail(),_fd(-1) {}
+			~URing (void)		{ close(); }
+			URing (const URing&) = delete;
+    void		operator= (const URing&) = delete;
+    constexpr bool	is_open (void) const	{ return _fd >= 0; }
+    bool		open (unsigned entries = DefaultEntries);
+    void		close (void);
+    io_uring_sqe*	get_sqe (void);
+    int			submit_and_wait (unsigned nwait, const timespec* ts = nullptr, const sigset_t* sigmask = nullptr);
+    const io_uring_cqe*	peek_cqe (void) const;
+    void		pop_cqe (void);
+private:
+    uint32_t*		_sqhead;
+    uint32_t*		_sqtail;
+    uint32_t*		_cqhead;
+    uint32_t*		_cqtail;
+    io_uring_sqe*	_sqes;
+    const io_uring_cqe*	_cqes;
+    void*		_ring;
+    size_t		_ringsz;
+    size_t		_sqesz;
+    uint32_t		_sqmask;
+    uint32_t		_cqmask;
+    uint32_t		_sqlocaltail;	// sqes filled, but not yet published to the kernel
+    int			_fd;
+};
+
 //}}}-------------------------------------------------------------------
 //{{{ chrono
 namespace chrono {
@@ -143,6 +186,15 @@ public:
     static rep	now (void);
 };
 
+// Monotonic, unaffected by wall clock changes, in nanoseconds
+class steady_clock {
+public:
+    using rep = uint64_t;
+    static constexpr const rep period = 1;
+public:
+    static rep	now (void);
+};
+
 } // namespace chrono
 } // namespace cwiclo
 //}}}-------------------------------------------------------------------
@@ -25,7 +25,7 @@ test/check:	${test/tests}
 	    diff $$test.std $$i.out && rm -f $$i.out;\
 	done
 
-$Otest/ipcom:	| $Otest/ipcomsrv
+$Otest/ipcom $Otest/rings $Otest/fdpas:	| $Otest/ipcomsrv
 
 ${test/tests}: $Otest/%: $Otest/%.o ${liba}
 	@echo "Linking $@ ..."
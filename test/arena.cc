@@ -0,0 +1,149 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// With the body arena enabled, message bodies are allocated from it
+// until it is full, and released wholesale two iterations later.
+// Messages kept longer or forwarded are moved out of it. Bodies small
+// enough to be stored inline in Msg do not use the arena, so the value
+// is sent with a note making it larger.
+
+class IValue : public Interface {
+    DECLARE_INTERFACE (Interface, Value, (value,"us"))
+public:
+    static constexpr const char c_Note[] = "too long to be stored inline";
+public:
+    explicit	IValue (mrid_t caller)		: Interface (caller) {}
+    void	value (uint32_t v) const	{ send (m_value(), v, string_view (c_Note)); }
+    void	forward (Msg&& msg) const	{ forward_msg (move(msg)); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_value())
+	    return Interface::dispatch (o, msg);
+	o->Value_value (msg.read().read<uint32_t>());
+	return true;
+    }
+public:
+    class Reply : public Interface::Reply {
+    public:
+	constexpr	Reply (Msg::Link l)		: Interface::Reply (l) {}
+	void		value (uint32_t v) const	{ send (m_value(), v, string_view (c_Note)); }
+
+	template <typename O>
+	inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	    if (msg.method() != m_value())
+		return Interface::Reply::dispatch (o, msg);
+	    o->Value_value (msg.read().read<uint32_t>());
+	    return true;
+	}
+    };
+};
+
+// Keeps received messages until asked to report them with value 0
+class KeepMsger : public Msger {
+public:
+    explicit	KeepMsger (Msg::Link l)	: Msger(l),_kept() {}
+    bool	dispatch (Msg& msg) override {
+		    if (!IValue::has_method (msg.method()))
+			return Msger::dispatch (msg);
+		    if (msg.read().read<uint32_t>())
+			_kept.emplace_back (move(msg));
+		    else
+			report();
+		    return true;
+		}
+private:
+    void	report (void) {
+		    uint32_t sum = 0;
+		    for (auto& m : _kept)
+			sum += m.read().read<uint32_t>();
+		    log ("Msger %hu kept %u values, sum %u\n", msger_id(), _kept.size(), sum);
+		    reply<IValue>().value (sum);
+		}
+private:
+    vector<Msg>	_kept;
+};
+
+// Forwards values to a KeepMsger
+class RelayMsger : public Msger {
+public:
+    explicit	RelayMsger (Msg::Link l)	: Msger(l),_out(msger_id()) { _out.create_dest_as<KeepMsger>(); }
+    bool	dispatch (Msg& msg) override {
+		    if (!IValue::has_method (msg.method()))
+			return Msger::dispatch (msg);
+		    if (msg.src() == _out.dest())
+			reply<IValue>().value (msg.read().read<uint32_t>());
+		    else
+			_out.forward (move(msg));
+		    return true;
+		}
+private:
+    IValue	_out;
+};
+
+class EchoMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IValue),)
+public:
+    explicit	EchoMsger (Msg::Link l)		: Msger(l) {}
+    void	Value_value (uint32_t v) const	{ reply<IValue>().value (v); }
+};
+
+class TestApp : public AppL {
+    IMPLEMENT_INTERFACES (AppL,,(IValue))
+public:
+    enum { NValues = 100, NEchoes = 5 };
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+    void		Value_value (uint32_t v);
+private:
+			TestApp (void);
+private:
+    IValue		_keep;
+    IValue		_relay;
+    IValue		_echo;
+    unsigned		_nechoes;
+    unsigned		_nsums;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_keep (mrid_App)
+,_relay (mrid_App)
+,_echo (mrid_App)
+,_nechoes (0)
+,_nsums (0)
+{
+    set_body_arena_size (256);	// far less than needed for all values
+    _keep.create_dest_as<KeepMsger>();
+    _relay.create_dest_as<RelayMsger>();
+    _echo.value (1);	// the arena is allocated in the loop
+}
+
+void TestApp::Value_value (uint32_t v)
+{
+    if (_nechoes < NEchoes) {
+	// Echoes overwrite the arena while the values are kept
+	if (++_nechoes == 1) {
+	    for (auto i = 1u; i <= NValues; ++i) {
+		_keep.value (i);
+		_relay.value (i*2);
+	    }
+	}
+	if (_nechoes == NEchoes) {
+	    _keep.value (0);
+	    _relay.value (0);
+	} else
+	    _echo.value (v+NValues);
+    } else {
+	log ("Sum %u received\n", v);
+	if (++_nsums == 2)
+	    quit();
+    }
+}
+
+CWICLO_APP_L (TestApp, (EchoMsger))
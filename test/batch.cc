@@ -0,0 +1,93 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// In batch dispatch mode, the input queue is grouped by destination and
+// each Msger gets its messages together with dispatch_batch, as far as
+// the order of messages from each sender allows.
+
+class IValue : public Interface {
+    DECLARE_INTERFACE (Interface, Value, (value,"u"))
+public:
+    explicit	IValue (mrid_t caller)		: Interface (caller) {}
+		IValue (mrid_t caller, mrid_t dest)	: Interface (caller, dest) {}
+    void	value (uint32_t v) const	{ send (m_value(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_value())
+	    return Interface::dispatch (o, msg);
+	o->Value_value (msg.read().read<uint32_t>());
+	return true;
+    }
+};
+
+// Logs each batch as one line, like a write of N records would be
+class BatchMsger : public Msger {
+public:
+    explicit	BatchMsger (Msg::Link l)	: Msger(l) {}
+    bool	dispatch_batch (Msg* f, Msg* l) override {
+		    string line;
+		    line.appendf ("Msger %hu batch of %zu:", msger_id(), l-f);
+		    for (; f < l; ++f) {
+			if (!IValue::has_method (f->method()))
+			    return false;
+			line.appendf (" %u", f->read().read<uint32_t>());
+		    }
+		    log ("%s\n", line.c_str());
+		    return true;
+		}
+};
+
+// Uses the default dispatch_batch, calling dispatch for each message
+class ValueMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IValue),)
+public:
+    explicit	ValueMsger (Msg::Link l)	: Msger(l) {}
+    void	Value_value (uint32_t v) const	{ log ("Msger %hu value %u\n", msger_id(), v); }
+};
+
+// Sends each value to the Msger with mrid value/10
+class SenderMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IValue),)
+public:
+    explicit	SenderMsger (Msg::Link l)	: Msger(l) {}
+    void	Value_value (uint32_t v) const	{ IValue (msger_id(), v/10).value (v); }
+};
+
+class TestApp : public AppL {
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+private:
+			TestApp (void);
+private:
+    IValue		_values [3];
+    IValue		_senders [2];
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_values { IValue(mrid_App), IValue(mrid_App), IValue(mrid_App) }
+,_senders { IValue(mrid_App), IValue(mrid_App) }
+{
+    set_batch_dispatch();
+    _values[0].create_dest_as<BatchMsger>();
+    _values[1].create_dest_as<ValueMsger>();
+    _values[2].create_dest_as<BatchMsger>();
+    // From one sender, interleaved messages stay in order
+    for (auto i = 1u; i <= 2; ++i)
+	for (auto& v : _values)
+	    v.value (i);
+    // From two, grouped by destination. 13 follows 23 from the same
+    // sender, so it can not be grouped with 11 and 12.
+    for (auto& s : _senders)
+	s.create_dest_as<SenderMsger>();
+    for (auto v : { 11u, 21u, 12u, 22u, 31u, 23u, 13u })
+	_senders[v == 21 || v == 22].value (v);
+}
+
+CWICLO_APP_L (TestApp,)
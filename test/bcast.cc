@@ -0,0 +1,81 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Broadcast messages, like signals, are delivered only to Msgers that
+// list the interface in IMPLEMENT_INTERFACES, and to those that do not
+// use it and so may accept anything.
+
+class SignalMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger,,(ISignal))
+public:
+    explicit	SignalMsger (Msg::Link l)	: Msger(l) {}
+    void	Signal_signal (const ISignal::Info& si)
+		    { log ("Msger %hu received signal %d\n", msger_id(), si.sig); }
+};
+
+// Uses IMPLEMENT_INTERFACES without ISignal, so is never given it
+class TimerMsger : public Msger {
+    IMPLEMENT_INTERFACES_I_M (Msger,,(ITimer))
+public:
+    explicit	TimerMsger (Msg::Link l)	: Msger(l) {}
+    void	Timer_timer (fd_t)		{}
+    bool	dispatch (Msg& msg) override {
+		    log ("Msger %hu asked to dispatch %s.%s\n", msger_id(), msg.interface(), msg.method());
+		    return dispatch_interfaces (this, msg) || Msger::dispatch (msg);
+		}
+};
+
+// Does not say what it accepts, so is given all broadcasts
+class AnyMsger : public Msger {
+public:
+    explicit	AnyMsger (Msg::Link l)		: Msger(l) {}
+    bool	dispatch (Msg& msg) override {
+		    log ("Msger %hu asked to dispatch %s.%s\n", msger_id(), msg.interface(), msg.method());
+		    return false;
+		}
+};
+
+class TestApp : public AppL {
+    IMPLEMENT_INTERFACES (AppL,,(ISignal))
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+    void		Signal_signal (const ISignal::Info& si);
+private:
+			TestApp (void);
+private:
+    Interface		_msgers [5];
+    unsigned		_nsignals;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_msgers { Interface(mrid_App), Interface(mrid_App), Interface(mrid_App), Interface(mrid_App), Interface(mrid_App) }
+,_nsignals (0)
+{
+    _msgers[0].create_dest_as<SignalMsger>();
+    _msgers[1].create_dest_as<TimerMsger>();
+    _msgers[2].create_dest_as<AnyMsger>();
+    _msgers[3].create_dest_as<TimerMsger>();
+    _msgers[4].create_dest_as<SignalMsger>();
+    ISignal (mrid_App).signal ({ SIGUSR1, 0, 0, 0 });
+}
+
+void TestApp::Signal_signal (const ISignal::Info& si)
+{
+    log ("App received signal %d\n", si.sig);
+    if (++_nsignals == 1) {
+	// Msgers created after a broadcast receive the next one
+	_msgers[1].free_id();
+	_msgers[1].allocate_id();
+	_msgers[1].create_dest_as<SignalMsger>();
+	ISignal (mrid_App).signal ({ SIGUSR2, 0, 0, 0 });
+    } else
+	quit();
+}
+
+CWICLO_APP_L (TestApp,)
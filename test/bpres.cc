@@ -0,0 +1,83 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// A Msger with an inbox limit accepts only so many messages in one
+// iteration. Senders find out with dest_backlogged, pause, and are told
+// to resume with on_dest_drained after the messages are processed.
+
+class IValue : public Interface {
+    DECLARE_INTERFACE (Interface, Value, (value,"u"))
+public:
+    explicit	IValue (mrid_t caller)		: Interface (caller) {}
+    void	value (uint32_t v) const	{ send (m_value(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_value())
+	    return Interface::dispatch (o, msg);
+	o->Value_value (msg.read().read<uint32_t>());
+	return true;
+    }
+};
+
+enum { NValues = 35, InboxLimit = 10 };
+
+class SinkMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IValue),)
+public:
+    explicit	SinkMsger (Msg::Link l)		: Msger(l),_sum(0) { AppL::instance().set_inbox_limit (msger_id(), InboxLimit); }
+    void	Value_value (uint32_t v) {
+		    _sum += v;
+		    if (v == NValues) {
+			log ("Received values up to %u, sum %u\n", v, _sum);
+			AppL::instance().quit();
+		    }
+		}
+private:
+    uint32_t	_sum;
+};
+
+class TestApp : public AppL {
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+    void		on_dest_drained (mrid_t dest) override;
+private:
+			TestApp (void);
+    void		send_values (void);
+private:
+    IValue		_sink;
+    uint32_t		_nsent;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_sink (mrid_App)
+,_nsent (0)
+{
+    _sink.create_dest_as<SinkMsger>();
+    send_values();
+}
+
+void TestApp::send_values (void)
+{
+    while (_nsent < NValues) {
+	if (_sink.dest_backlogged()) {
+	    log ("Paused after %u values, %u queued\n", _nsent, has_messages_for (_sink.dest()));
+	    return;
+	}
+	_sink.value (++_nsent);
+    }
+}
+
+void TestApp::on_dest_drained (mrid_t dest)
+{
+    log ("Msger %hu drained\n", dest);
+    send_values();
+}
+
+CWICLO_APP_L (TestApp,)
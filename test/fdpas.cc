@@ -0,0 +1,52 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+#include "../xtern.h"
+#include <fcntl.h>
+
+//----------------------------------------------------------------------
+// fdpas passes to ipcomsrv the write ends of three pipes in each of
+// several messages. Sent together, they are written with one sendmsg
+// call passing all their fds, and ipcomsrv gives each message its own.
+
+class TestApp : public App {
+    IMPLEMENT_INTERFACES (App,,(IPipes))
+public:
+    enum { NMessages = 4, NPipes = 3 };
+    static auto& instance (void) { static TestApp s_app; return s_app; }
+    void Pipes_filled (uint32_t n) {
+	uint32_t v [NPipes] = {};
+	for (auto i = 0u; i < NPipes; ++i) {
+	    if (sizeof(v[i]) != read (_rfds[n][i], &v[i], sizeof(v[i])))
+		error_libc ("read");
+	    close (_rfds[n][i]);
+	}
+	log ("Message %u pipes contain %u, %u, %u\n", n, v[0], v[1], v[2]);
+	if (n+1 == NMessages)
+	    quit();
+    }
+private:
+    TestApp (void) : App(),_pipes (mrid_App),_rfds() {
+	for (auto n = 0u; n < NMessages; ++n) {
+	    fd_t wfds [NPipes];
+	    for (auto i = 0u; i < NPipes; ++i) {
+		int p[2];
+		if (0 > pipe2 (p, O_CLOEXEC)) {
+		    error_libc ("pipe");
+		    return;
+		}
+		_rfds[n][i] = p[0];
+		wfds[i] = p[1];
+	    }
+	    _pipes.fill (n, wfds[0], wfds[1], wfds[2]);
+	}
+    }
+private:
+    IPipes _pipes;
+    fd_t _rfds [NMessages][NPipes];
+};
+
+CWICLO_APP (TestApp,,(IPipes),)
@@ -12,22 +12,32 @@
 // now derived from extern-enabled App, and CWICLO_APP now contains the
 // list of imports. Connection to the server socket, or launching of the
 // ipcomsrv process is handled automatically by App.
+//
+// The output of ipcomsrv is part of the test's, so the test quits only
+// when ipcomsrv exits. Releasing the pinger closes the connection, and
+// ipcomsrv quits when it has none left. The timer limits the wait.
 
 class TestApp : public App {
-    IMPLEMENT_INTERFACES (App,,(IPing))
+    IMPLEMENT_INTERFACES (App,,(IPing)(ISignal)(ITimer))
 public:
     static auto& instance (void) { static TestApp s_app; return s_app; }
     void Ping_ping (uint32_t v) {
 	log ("Ping %u reply received in app\n", v);
 	if (++v < 5)
-	    _pinger.ping (v);
-	else
-	    quit();
+	    return _pinger.ping (v);
+	set_flag (f_ListenWhenEmpty);	// to not quit when the connection closes
+	_pinger.free_id();
+	_timer.timer (5000);
     }
+    void Signal_signal (const ISignal::Info& si)
+	{ if (si.sig == SIGCHLD) quit(); }
+    void Timer_timer (fd_t fd)
+	{ if (fd < 0) quit(); else App::Timer_timer (fd); }
 private:
-    TestApp (void) : App(),_pinger (mrid_App) { _pinger.ping (1); }
+    TestApp (void) : App(),_pinger (mrid_App),_timer (mrid_App) { _pinger.ping (1); }
 private:
     IPing _pinger;
+    ITimer _timer;
 };
 
 CWICLO_APP (TestApp,,(IPing),)
@@ -8,12 +8,13 @@
 
 //----------------------------------------------------------------------
 // ipcomsrv illustrates exporting the Ping interface through a socket to
-// another process. The client side is implemented in ipcom.
+// another process. The client side is implemented in ipcom. It also
+// offers shared memory rings, used by the rings client, but not ipcom.
 
 class TestApp : public App {
-			TestApp (void) : App() {}
+			TestApp (void) : App() { set_extern_rings(); }
 public:
     static auto&	instance (void) { static TestApp s_app; return s_app; }
 };
 
-CWICLO_APP (TestApp, (PingMsger),,(IPing))
+CWICLO_APP (TestApp, (PingMsger)(PipesMsger),,(IPing)(IPipes))
@@ -0,0 +1,107 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Messages are dispatched by priority lane of their interface, with
+// High messages overtaking the rest sent in the same iteration. Lower
+// lanes are not starved; they get a message dispatched after each
+// LaneBurst messages from the lanes above them.
+
+class IBulk : public Interface {
+    DECLARE_INTERFACE_P (Interface, Bulk, (data,"u"), Low)
+public:
+    explicit	IBulk (mrid_t caller)		: Interface (caller) {}
+    void	data (uint32_t v) const		{ send (m_data(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_data())
+	    return Interface::dispatch (o, msg);
+	o->Bulk_data (msg.read().read<uint32_t>());
+	return true;
+    }
+};
+
+class IStatus : public Interface {
+    DECLARE_INTERFACE (Interface, Status, (status,"u"))
+public:
+    explicit	IStatus (mrid_t caller)		: Interface (caller) {}
+    void	status (uint32_t v) const	{ send (m_status(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_status())
+	    return Interface::dispatch (o, msg);
+	o->Status_status (msg.read().read<uint32_t>());
+	return true;
+    }
+};
+
+class ICancel : public Interface {
+    DECLARE_INTERFACE_P (Interface, Cancel, (cancel,"u"), High)
+public:
+    explicit	ICancel (mrid_t caller)		: Interface (caller) {}
+    void	cancel (uint32_t v) const	{ send (m_cancel(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_cancel())
+	    return Interface::dispatch (o, msg);
+	o->Cancel_cancel (msg.read().read<uint32_t>());
+	return true;
+    }
+};
+
+enum { NCancels = 150 };
+static uint32_t s_ncancels = 0;
+
+// One is created for each interface, all sharing the cancel count
+class WorkMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IBulk)(IStatus)(ICancel),)
+public:
+    explicit	WorkMsger (Msg::Link l)		: Msger(l) {}
+    void	Bulk_data (uint32_t v) const	{ log ("Bulk %u after %u cancels\n", v, s_ncancels); }
+    void	Status_status (uint32_t v) const { log ("Status %u after %u cancels\n", v, s_ncancels); }
+    void	Cancel_cancel (uint32_t v) const {
+		    if (!s_ncancels++)
+			log ("Cancel %u dispatched first\n", v);
+		    if (s_ncancels == NCancels) {
+			log ("Received %u cancels\n", s_ncancels);
+			AppL::instance().quit();
+		    }
+		}
+};
+
+class TestApp : public AppL {
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+private:
+			TestApp (void);
+};
+
+TestApp::TestApp (void)
+: AppL()
+{
+    static_assert (IBulk::interface_priority() == Priority::Low);
+    static_assert (IStatus::interface_priority() == Priority::Normal);
+    IBulk bulk (mrid_App);
+    bulk.create_dest_as<WorkMsger>();
+    IStatus status (mrid_App);
+    status.create_dest_as<WorkMsger>();
+    ICancel cancel (mrid_App);
+    cancel.create_dest_as<WorkMsger>();
+
+    // All sent in one iteration, bulk data first
+    for (auto i = 1u; i <= 2; ++i) {
+	bulk.data (i);
+	status.status (i);
+    }
+    for (auto i = 1u; i <= NCancels; ++i)
+	cancel.cancel (i);
+}
+
+CWICLO_APP_L (TestApp,)
@@ -167,3 +167,56 @@ public:
 private:
     uint32_t		_npings;
 };
+
+//----------------------------------------------------------------------
+// Pipes passes several fds in one message, used by the fdpas test.
+// The fds are consecutive in the body, one for each h in the signature,
+// with the offset of the first given to create_msg. PipesMsger writes
+// the message number into each passed pipe, and replies when done.
+//
+class IPipes : public Interface {
+    DECLARE_INTERFACE_E (Interface, Pipes, (fill,"uhhh")(filled,"u"), "@~cwiclo/test/pipes.socket", "ipcomsrv");
+public:
+    explicit IPipes (mrid_t caller) : Interface (caller) {}
+    void fill (uint32_t n, fd_t a, fd_t b, fd_t c) const {
+	auto& msg = create_msg (m_fill(), stream_sizeof(n)+3*stream_sizeof(a), stream_sizeof(n));
+	commit_msg (msg, msg.write() << n << a << b << c);
+    }
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_fill())
+	    return Interface::dispatch (o, msg);
+	auto is = msg.read();
+	auto n = is.read<uint32_t>();
+	auto a = is.read<fd_t>(), b = is.read<fd_t>(), c = is.read<fd_t>();
+	o->Pipes_fill (n, a, b, c);
+	return true;
+    }
+public:
+    class Reply : public Interface::Reply {
+    public:
+	constexpr Reply (Msg::Link l) : Interface::Reply (l) {}
+	void filled (uint32_t n) const { send (m_filled(), n); }
+	template <typename O>
+	inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	    if (msg.method() != m_filled())
+		return Interface::Reply::dispatch (o, msg);
+	    o->Pipes_filled (msg.read().read<uint32_t>());
+	    return true;
+	}
+    };
+};
+
+class PipesMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IPipes),)
+public:
+    explicit		PipesMsger (Msg::Link l) : Msger(l) {}
+    void		Pipes_fill (uint32_t n, fd_t a, fd_t b, fd_t c) {
+			    for (auto fd : {a,b,c}) {
+				if (sizeof(n) != write (fd, &n, sizeof(n)))
+				    error_libc ("write");
+				close (fd);
+			    }
+			    reply<IPipes>().filled (n);
+			}
+};
@@ -0,0 +1,103 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+#include <pthread.h>
+
+//----------------------------------------------------------------------
+// Threads other than the one running the message loop may not use the
+// output queue, but may post messages to the loop with AppL::post.
+
+class ICount : public Interface {
+    DECLARE_INTERFACE (Interface, Count, (count,"uu"))
+public:
+    explicit	ICount (mrid_t caller)	: Interface (caller) {}
+    // Called from the posting threads, so the message is built by hand
+    static void	post_count (Msg::Link l, uint32_t thread, uint32_t seq) {
+		    Msg msg (l, m_count(), stream_sizeof(thread)+stream_sizeof(seq));
+		    msg.write() << thread << seq;
+		    AppL::instance().post (move(msg));
+		}
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_count())
+	    return Interface::dispatch (o, msg);
+	auto is = msg.read();
+	auto thread = is.read<uint32_t>();
+	auto seq = is.read<uint32_t>();
+	o->Count_count (thread, seq);
+	return true;
+    }
+};
+
+enum { NThreads = 4, NPosts = 20000 };
+
+class CountMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (ICount),)
+public:
+    explicit	CountMsger (Msg::Link l)	: Msger(l),_next{},_nreceived(0),_nmisordered(0) {}
+    void	Count_count (uint32_t thread, uint32_t seq) {
+		    // Each thread's messages must arrive in the order posted
+		    if (_next[thread]++ != seq)
+			++_nmisordered;
+		    if (++_nreceived < NThreads*NPosts)
+			return;
+		    log ("Received %u messages from %u threads, %u out of order\n", _nreceived, NThreads, _nmisordered);
+		    AppL::instance().quit();
+		}
+private:
+    uint32_t	_next [NThreads];
+    uint32_t	_nreceived;
+    uint32_t	_nmisordered;
+};
+
+class TestApp : public AppL {
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+private:
+			TestApp (void);
+			~TestApp (void) override;
+    static void*	post_thread (void* arg);
+private:
+    struct PostArgs {
+	Msg::Link	l;
+	uint32_t	thread;
+    };
+private:
+    ICount		_counter;
+    pthread_t		_threads [NThreads];
+    PostArgs		_args [NThreads];
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_counter (mrid_App)
+,_threads{}
+,_args{}
+{
+    open_post_queue();
+    for (auto i = 0u; i < NThreads; ++i) {
+	_args[i] = { _counter.link(), i };
+	if (0 != pthread_create (&_threads[i], nullptr, post_thread, &_args[i]))
+	    error ("pthread_create failed");
+    }
+}
+
+TestApp::~TestApp (void)
+{
+    for (auto t : _threads)
+	pthread_join (t, nullptr);
+}
+
+void* TestApp::post_thread (void* arg) // static
+{
+    auto a = static_cast<const PostArgs*>(arg);
+    for (auto i = 0u; i < NPosts; ++i)
+	ICount::post_count (a->l, a->thread, i);
+    return nullptr;
+}
+
+CWICLO_APP_L (TestApp, (AppL::Timer)(CountMsger))
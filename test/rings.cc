@@ -0,0 +1,43 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+#include "../xtern.h"
+
+//----------------------------------------------------------------------
+// rings is ipcom with shared memory rings offered to ipcomsrv, which
+// offers them too. After the handshake, messages go through the rings,
+// and the socket is only used to pass fds and to detect disconnection.
+//
+// The output of ipcomsrv is part of the test's, so the test quits only
+// when ipcomsrv exits. Releasing the pinger closes the connection, and
+// ipcomsrv quits when it has none left. The timer limits the wait.
+
+class TestApp : public App {
+    IMPLEMENT_INTERFACES (App,,(IPing)(ISignal)(ITimer))
+public:
+    static auto& instance (void) { static TestApp s_app; return s_app; }
+    void Ping_ping (uint32_t v) {
+	log ("Ping %u reply received in app\n", v);
+	if (++v < 5)
+	    return _pinger.ping (v);
+	auto e = create_extern_dest_for (IPing::interface());
+	log ("Connection %s shared memory rings\n", e && e->info().uses_rings ? "uses" : "does not use");
+	set_flag (f_ListenWhenEmpty);	// to not quit when the connection closes
+	_pinger.free_id();
+	_timer.timer (5000);
+    }
+    void Signal_signal (const ISignal::Info& si)
+	{ if (si.sig == SIGCHLD) quit(); }
+    void Timer_timer (fd_t fd)
+	{ if (fd < 0) quit(); else App::Timer_timer (fd); }
+private:
+    TestApp (void) : App(),_pinger (mrid_App),_timer (mrid_App) { set_extern_rings(); _pinger.ping (1); }
+private:
+    IPing _pinger;
+    ITimer _timer;
+};
+
+CWICLO_APP (TestApp,,(IPing),)
@@ -0,0 +1,110 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// resend replaces the message of the same method on the same link,
+// if it is still in the output queue, instead of queueing another.
+// This is useful for status updates, where only the latest matters.
+
+class IStatus : public Interface {
+    DECLARE_INTERFACE (Interface, Status, (status,"u")(count,"u"))
+public:
+    explicit	IStatus (mrid_t caller)		: Interface (caller) {}
+    void	status (uint32_t v) const	{ resend (m_status(), v); }
+    void	count (uint32_t v) const	{ send (m_count(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() == m_status())
+	    o->Status_status (msg.read().read<uint32_t>());
+	else if (msg.method() == m_count())
+	    o->Status_count (msg.read().read<uint32_t>());
+	else
+	    return Interface::dispatch (o, msg);
+	return true;
+    }
+public:
+    class Reply : public Interface::Reply {
+    public:
+	constexpr	Reply (Msg::Link l)		: Interface::Reply (l) {}
+	void		status (uint32_t v) const	{ resend (m_status(), v); }
+
+	template <typename O>
+	inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	    if (msg.method() != m_status())
+		return Interface::Reply::dispatch (o, msg);
+	    o->Status_status (msg.read().read<uint32_t>());
+	    return true;
+	}
+    };
+};
+
+class StatusMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IStatus),)
+public:
+    explicit	StatusMsger (Msg::Link l)	: Msger(l),_ncounts(0),_sum(0) {}
+		~StatusMsger (void) override
+		    { log ("Status%hu: %u counts, sum %u\n", msger_id(), _ncounts, _sum); }
+    void	Status_status (uint32_t v) {
+		    log ("Status%hu: %u after %u counts\n", msger_id(), v, _ncounts);
+		    reply<IStatus>().status (v);
+		}
+    void	Status_count (uint32_t v)	{ ++_ncounts; _sum += v; }
+private:
+    uint32_t	_ncounts;
+    uint32_t	_sum;
+};
+
+class TestApp : public AppL {
+    IMPLEMENT_INTERFACES (AppL,,(IStatus))
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+    void		Status_status (uint32_t v);
+private:
+			TestApp (void);
+private:
+    IStatus		_a;
+    IStatus		_b;
+    unsigned		_nreplies;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_a (mrid_App)
+,_b (mrid_App)
+,_nreplies (0)
+{
+    // Updates on different links are independent
+    _a.status (1);
+    _b.status (10);
+    _a.status (2);
+    _b.status (20);
+    _a.status (3);
+    // Many messages in between do not hide the queued status,
+    // which keeps its place in the queue when replaced.
+    for (auto i = 0u; i < 200; ++i) {
+	_a.count (i);
+	_a.status (100+i);
+    }
+}
+
+void TestApp::Status_status (uint32_t v)
+{
+    log ("Status %u reply received in app\n", v);
+    if (++_nreplies == 2) {
+	// The next iteration starts with an empty queue
+	_a.status (4);
+	_a.status (5);
+	_b.status (50);
+    } else if (_nreplies == 4) {
+	_a.free_id();
+	_b.free_id();
+	quit();
+    }
+}
+
+CWICLO_APP_L (TestApp, (StatusMsger))
@@ -0,0 +1,53 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+#include <signal.h>
+
+//----------------------------------------------------------------------
+// Signals are forwarded as ISignal messages, whether they arrive outside
+// or during the wait. The timer is long enough that the test fails if
+// the wait is not woken by the signal.
+
+class TestApp : public AppL {
+    IMPLEMENT_INTERFACES (AppL,,(ISignal)(ITimer))
+public:
+    enum { ChildStatus = 7 };
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+    void		Signal_signal (const ISignal::Info& si);
+    void		Timer_timer (fd_t)	{ log ("Timed out\n"); quit(); }
+private:
+			TestApp (void);
+private:
+    ITimer		_timer;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_timer (mrid_App)
+{
+    _timer.timer (5000);
+    raise (SIGUSR1);
+}
+
+void TestApp::Signal_signal (const ISignal::Info& si)
+{
+    if (si.sig == SIGUSR1) {
+	log ("Received SIGUSR1 raised outside the wait\n");
+	// The child exits while the loop is waiting for the timer
+	if (auto pid = fork(); pid < 0)
+	    error_libc ("fork");
+	else if (!pid) {
+	    usleep (20000);
+	    _exit (ChildStatus);
+	}
+    } else if (si.sig == SIGCHLD) {
+	log ("Child exited with %d while waiting\n", WEXITSTATUS (si.status));
+	quit();
+    }
+}
+
+CWICLO_APP_L (TestApp, (AppL::Timer))
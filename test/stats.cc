@@ -0,0 +1,82 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// AppL counts dispatched messages, timers, and Msgers created and
+// deleted, reporting them through IStats when AppL::Stats is in the
+// Msger list. Times vary, so only their histogram totals are checked.
+
+class IValue : public Interface {
+    DECLARE_INTERFACE (Interface, Value, (value,"u"))
+public:
+    explicit	IValue (mrid_t caller)		: Interface (caller) {}
+    void	value (uint32_t v) const	{ send (m_value(), v); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_value())
+	    return Interface::dispatch (o, msg);
+	o->Value_value (msg.read().read<uint32_t>());
+	return true;
+    }
+};
+
+enum { NValues = 10 };
+
+class ValueMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IValue),)
+public:
+    explicit	ValueMsger (Msg::Link l)	: Msger(l) {}
+    void	Value_value (uint32_t v)	{ set_unused (v == NValues); }
+};
+
+class TestApp : public AppL {
+    IMPLEMENT_INTERFACES (AppL,,(ITimer)(IStats))
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+    void		Timer_timer (fd_t)	{ _stats.get(); }
+    void		Stats_stats (const IStats::Counters& c, const vector<uint64_t>& busyhist, const vector<uint64_t>& depthhist, const vector<IStats::MethodCount>& methods);
+private:
+			TestApp (void);
+private:
+    IValue		_value;
+    ITimer		_timer;
+    IStats		_stats;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_value (mrid_App)
+,_timer (mrid_App)
+,_stats (mrid_App)
+{
+    _value.create_dest_as<ValueMsger>();
+    for (auto i = 1u; i <= NValues; ++i)
+	_value.value (i);
+    _timer.timer (1);
+}
+
+void TestApp::Stats_stats (const IStats::Counters& c, const vector<uint64_t>& busyhist, const vector<uint64_t>& depthhist, const vector<IStats::MethodCount>& methods)
+{
+    // The table is in hash order
+    vector<string> lines;
+    for (auto& m : methods)
+	lines.emplace_back().appendf ("%s.%s: %lu", m.iface.data(), m.method.data(), m.n);
+    sort (lines);
+    for (auto& l : lines)
+	log ("%s\n", l.c_str());
+    log ("Dispatched %lu, most %lu at once\n", c.dispatched, c.maxdepth);
+    log ("Timers fired %lu\n", c.timers);
+    log ("Msgers created %lu, deleted %lu\n", c.created, c.deleted);
+
+    auto sum = [](const vector<uint64_t>& h) { uint64_t s = 0; for (auto n : h) s += n; return s; };
+    log ("Histograms have %zu bins, %s iterations\n", busyhist.size(),
+	    sum (busyhist) == c.iterations && sum (depthhist) == c.iterations ? "counting all" : "missing");
+    quit();
+}
+
+CWICLO_APP_L (TestApp, (AppL::Timer)(AppL::Stats))
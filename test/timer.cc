@@ -0,0 +1,110 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Timer replies identify the timer only by the watched fd, so each
+// timer here watches the read end of an otherwise unused pipe. Nothing
+// is written to the pipes, so the timers all fire on timeout. Timers
+// fired by one wakeup are dispatched together, while separate wakeups
+// are at least 10ms apart, so counting the gaps between firings longer
+// than that counts wakeups, checking that slack coalesces them.
+
+class TestApp : public AppL {
+    IMPLEMENT_INTERFACES (AppL,,(ITimer))
+public:
+    enum { NTimers = 5 };
+    static constexpr nstime_t WakeupGap = 5*1000000;
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+    void		Timer_timer (fd_t fd);
+private:
+			TestApp (void);
+			~TestApp (void) override;
+    void		start_round (void);
+private:
+    ITimer		_timers [NTimers];
+    fd_t		_pipes [NTimers][2];
+    unsigned		_nfired;
+    unsigned		_round;
+    unsigned		_nwakeups;
+    nstime_t		_lastfire;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_timers { ITimer(mrid_App), ITimer(mrid_App), ITimer(mrid_App), ITimer(mrid_App), ITimer(mrid_App) }
+,_pipes{}
+,_nfired (0)
+,_round (0)
+,_nwakeups (0)
+,_lastfire (0)
+{
+    for (auto& p : _pipes)
+	if (0 > pipe (p))
+	    error_libc ("pipe");
+    start_round();
+}
+
+TestApp::~TestApp (void)
+{
+    for (auto& p : _pipes)
+	for (auto fd : p)
+	    close (fd);
+}
+
+void TestApp::start_round (void)
+{
+    using WC = ITimer::WatchCmd;
+    if (_round == 1) {
+	log ("With 50ms slack\n");
+	set_timer_slack (50*1000000);
+    } else if (_round == 2) {
+	log ("With sub-ms deadlines\n");
+	set_timer_slack (0);
+	// Deadlines are absolute steady_clock times in ns
+	auto now = ITimer::now();
+	_timers[0].watch_until (WC::ReadTimer, _pipes[0][0], now + 1800000);
+	_timers[1].watch_until (WC::ReadTimer, _pipes[1][0], now + 300000);
+	_timers[2].watch_until (WC::ReadTimer, _pipes[2][0], now + 900000);
+	_timers[3].watch_until (WC::ReadTimer, _pipes[3][0], now + 600000);
+	_timers[4].watch_until (WC::ReadTimer, _pipes[4][0], now + 1200000);
+	_timers[4].stop();
+	return;
+    }
+    // Deadlines are set out of order, and one timer is rescheduled
+    _timers[0].watch (WC::ReadTimer, _pipes[0][0], 30);
+    _timers[1].watch (WC::ReadTimer, _pipes[1][0], 10);
+    _timers[2].watch (WC::ReadTimer, _pipes[2][0], 50);
+    _timers[3].watch (WC::ReadTimer, _pipes[3][0], 10);	// ties fire in creation order
+    _timers[4].watch (WC::ReadTimer, _pipes[4][0], 40);
+    _timers[2].watch (WC::ReadTimer, _pipes[2][0], 20);
+    _timers[4].stop();	// and one is cancelled
+}
+
+void TestApp::Timer_timer (fd_t fd)
+{
+    for (auto i = 0u; i < NTimers; ++i)
+	if (_pipes[i][0] == fd)
+	    log ("Timer %u fired\n", i);
+    nstime_t now = ITimer::now();
+    if (!_nfired || now - _lastfire > WakeupGap)
+	++_nwakeups;
+    _lastfire = now;
+    if (++_nfired < NTimers-1)
+	return;
+    // Sub-ms deadlines are too close together to tell
+    if (_round < 2)
+	log ("Fired in %s\n", _nwakeups == 1 ? "one wakeup" : "several wakeups");
+    _nwakeups = 0;
+    _nfired = 0;
+    if (++_round < 3)
+	start_round();
+    else
+	quit();
+}
+
+CWICLO_APP_L (TestApp, (AppL::Timer))
@@ -0,0 +1,76 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// The binary message trace records each dispatched message, with the
+// beginning of its body, in a file that MsgTrace::print decodes in the
+// same format as the -d trace. The msgtrace tool prints it likewise.
+
+class IText : public Interface {
+    DECLARE_INTERFACE (Interface, Text, (text,"s"))
+public:
+    explicit	IText (mrid_t caller)		: Interface (caller) {}
+    void	text (const string_view& s) const	{ send (m_text(), s); }
+
+    template <typename O>
+    inline static constexpr bool dispatch (O* o, const Msg& msg) {
+	if (msg.method() != m_text())
+	    return Interface::dispatch (o, msg);
+	o->Text_text (msg.read().read<string_view>());
+	return true;
+    }
+};
+
+class TextMsger : public Msger {
+    IMPLEMENT_INTERFACES (Msger, (IText),)
+public:
+    explicit	TextMsger (Msg::Link l)		: Msger(l) {}
+    void	Text_text (const string_view& s) const;
+};
+
+void TextMsger::Text_text (const string_view& s) const
+{
+    if (s != "done")
+	return;
+    // The trace file is complete up to this message
+    auto& app = AppL::instance();
+    char filename [64];
+    snprintf (ARRAY_BLOCK(filename), "/tmp/cwiclo-trace.%d", getpid());
+    log ("Traced %d messages\n", MsgTrace::print (filename));
+    app.msg_trace().close();
+    unlink (filename);
+    app.quit();
+}
+
+class TestApp : public AppL {
+public:
+    static auto&	instance (void) { static TestApp s_app; return s_app; }
+private:
+			TestApp (void);
+private:
+    IText		_text;
+};
+
+TestApp::TestApp (void)
+: AppL()
+,_text (mrid_App)
+{
+    char filename [64];
+    snprintf (ARRAY_BLOCK(filename), "/tmp/cwiclo-trace.%d", getpid());
+    if (!msg_trace().open (filename, 4)) {	// too few for all messages
+	error_libc ("open trace");
+	return;
+    }
+    _text.create_dest_as<TextMsger>();
+    _text.text ("first, overwritten");
+    _text.text ("hello");
+    _text.text ("a message longer than the body prefix kept in the trace");
+    _text.text ("world");
+    _text.text ("done");
+}
+
+CWICLO_APP_L (TestApp,)
@@ -0,0 +1,30 @@
+################ Source files ##########################################
+
+tools/srcs	:= $(wildcard tools/*.cc)
+tools/tools	:= $(addprefix $O,$(tools/srcs:.cc=))
+tools/objs	:= $(addprefix $O,$(tools/srcs:.cc=.o))
+tools/deps	:= ${tools/objs:.o=.d}
+
+################ Compilation ###########################################
+
+.PHONY:	tools/all tools/clean
+
+all:		tools/all
+tools/all:	${tools/tools}
+
+${tools/tools}: $Otools/%: $Otools/%.o ${liba}
+	@echo "Linking $@ ..."
+	@${CC} ${ldflags} -o $@ $^
+
+################ Maintenance ###########################################
+
+clean:	tools/clean
+tools/clean:
+	@if [ -d ${builddir}/tools ]; then\
+	    rm -f ${tools/tools} ${tools/objs} ${tools/deps} $Otools/.d;\
+	    rmdir ${builddir}/tools;\
+	fi
+
+${tools/objs}: Makefile tools/Module.mk ${confs} | $Otools/.d
+
+-include ${tools/deps}
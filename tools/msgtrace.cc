@@ -0,0 +1,24 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "../trace.h"
+using namespace cwiclo;
+
+//----------------------------------------------------------------------
+// msgtrace prints the messages recorded in a binary trace file, written
+// by apps run with CWICLO_MSG_TRACE set to its name.
+
+int main (int argc, const char* const* argv)
+{
+    if (argc != 2) {
+	fprintf (stderr, "Usage: msgtrace <tracefile>\n");
+	return EXIT_FAILURE;
+    }
+    if (0 > MsgTrace::print (argv[1])) {
+	perror (argv[1]);
+	return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#include "trace.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+//{{{ MsgTrace ---------------------------------------------------------
+namespace cwiclo {
+
+// Creates filename, or truncates it, and maps it for tracing.
+// Returns false on failure, with errno set.
+bool MsgTrace::open (const char* filename, uint32_t nrecords, uint32_t bodyprefix)
+{
+    close();
+    nrecords = ceil2 (max (nrecords, 2u));
+    auto mapsz = sizeof(Header) + DefaultNames + nrecords*sizeof(Record);
+    int fd = ::open (filename, O_RDWR| O_CREAT| O_TRUNC| O_CLOEXEC, 0600);
+    if (fd < 0)
+	return false;
+    void* p = MAP_FAILED;
+    if (0 <= ftruncate (fd, mapsz))
+	p = mmap (nullptr, mapsz, PROT_READ| PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close (fd);	// the mapping keeps the file
+    if (p == MAP_FAILED)
+	return false;
+    _mapsz = mapsz;
+    _bodyprefix = min (bodyprefix, uint32_t(BodyPrefix));
+    _mask = nrecords-1;
+    _h = static_cast<Header*>(p);
+    _names = pointer_cast<char>(_h+1);
+    _records = pointer_cast<Record>(_names + DefaultNames);
+    _h->version = Version;
+    _h->bodyprefix = _bodyprefix;
+    _h->nrecords = nrecords;
+    _h->namecap = DefaultNames;
+    _h->pid = getpid();
+    __atomic_store_n (&_h->magic, Magic, int(memory_order::release));	// written last, to mark the file complete
+    return true;
+}
+
+void MsgTrace::close (void)
+{
+    if (_h)
+	munmap (exchange (_h, nullptr), _mapsz);
+    _names = nullptr;
+    _records = nullptr;
+    _named.clear();
+    _nnamed = 0;
+}
+
+void MsgTrace::add_name (methodid_t mid)
+{
+    // Keep the set at most half full, rehashing when grown
+    if (_named.size() <= 2*_nnamed) {
+	vector<methodid_t> old;
+	old.swap (_named);
+	_named.resize (max (old.size()*2, decltype(old)::size_type(64)));
+	auto mask = _named.size()-1;
+	for (auto o : old) {
+	    if (!o)
+		continue;
+	    auto i = msg_trace_name_hash (o) >> (64-log2p1(mask));
+	    while (_named[i])
+		i = (i+1) & mask;
+	    _named[i] = o;
+	}
+    }
+    auto mask = _named.size()-1;
+    auto i = msg_trace_name_hash (mid) >> (64-log2p1(mask));
+    while (_named[i])
+	i = (i+1) & mask;
+    _named[i] = mid;
+    ++_nnamed;
+
+    // When the name table is full, the method is printed as a pointer
+    auto iface = interface_of_method (mid);
+    auto ilen = zstr::length (iface)+1, mlen = zstr::length (mid)+1;
+    auto esz = ceilg (sizeof(uint64_t)+ilen+mlen, sizeof(uint64_t));
+    auto used = _h->nameused;
+    if (used + esz > _h->namecap)
+	return;
+    auto e = _names + used;
+    *pointer_cast<uint64_t>(e) = uintptr_t (mid);
+    auto t = copy_n (iface, ilen, e+sizeof(uint64_t));
+    t = copy_n (mid, mlen, t);
+    zero_fill (t, e+esz);
+    __atomic_store_n (&_h->nameused, used+esz, int(memory_order::release));
+}
+
+// Prints the messages traced in filename in the format of the -d trace.
+// Can be used while the traced process is running. Returns the number
+// of messages printed, or -1 on failure, with errno set.
+int MsgTrace::print (const char* filename) // static
+{
+    int fd = ::open (filename, O_RDONLY| O_CLOEXEC);
+    if (fd < 0)
+	return -1;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (0 <= fstat (fd, &st) && size_t(st.st_size) >= sizeof(Header))
+	p = mmap (nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    else
+	errno = EINVAL;
+    ::close (fd);
+    if (p == MAP_FAILED)
+	return -1;
+    auto unmap = make_scope_exit ([&]{ munmap (p, st.st_size); });
+
+    auto h = static_cast<const Header*>(p);
+    if (__atomic_load_n (&h->magic, int(memory_order::acquire)) != Magic || h->version != Version
+	    || h->nrecords & (h->nrecords-1)
+	    || size_t(st.st_size) < sizeof(Header) + h->namecap + h->nrecords*sizeof(Record)) {
+	errno = EINVAL;
+	return -1;
+    }
+    auto names = pointer_cast<char>(h+1);
+    auto records = pointer_cast<Record>(names + h->namecap);
+    auto name_of = [&](uint64_t mid, const char*& iface, const char*& method) {
+	auto nused = __atomic_load_n (&h->nameused, int(memory_order::acquire));
+	for (auto e = names, eend = names + min (nused, h->namecap); e < eend;) {
+	    iface = e + sizeof(uint64_t);
+	    method = iface + zstr::length (iface)+1;
+	    if (*pointer_cast<uint64_t>(e) == mid)
+		return true;
+	    e += ceilg (method + zstr::length (method)+1 - e, streamsize(sizeof(uint64_t)));
+	}
+	return false;
+    };
+
+    // Records may be overwritten by the traced process while being read,
+    // so each is copied and used only if its seq is unchanged.
+    auto nwritten = __atomic_load_n (&h->nwritten, int(memory_order::acquire));
+    auto first = nwritten > h->nrecords ? nwritten - h->nrecords : 0;
+    if (first)
+	printf ("[T] %lu earlier messages overwritten\n", first);
+    int nprinted = 0;
+    for (auto i = first; i < nwritten; ++i) {
+	auto& rr = records [i & (h->nrecords-1)];
+	auto seq = __atomic_load_n (&rr.seq, int(memory_order::acquire));
+	auto r = rr;
+	__atomic_thread_fence (int(memory_order::acquire));
+	if (seq != uint32_t(i) || seq != __atomic_load_n (&rr.seq, int(memory_order::relaxed))) {
+	    printf ("[T] Message %lu overwritten\n", i);
+	    continue;
+	}
+	const char *iface, *method;
+	char mname [24];
+	if (!name_of (r.method, iface, method)) {
+	    snprintf (ARRAY_BLOCK(mname), "%lx", r.method);
+	    iface = "?";
+	    method = mname;
+	}
+	printf ("Msg: %hu -> %hu.%s.%s [%u] = {""{{\n", r.src, r.dest, iface, method, r.size);
+	auto nbody = min (r.size, uint32_t(h->bodyprefix));
+	hexdump (r.body, nbody);
+	if (nbody < r.size)
+	    printf ("... %u more bytes\n", r.size-nbody);
+	printf ("}""}}\n");
+	++nprinted;
+    }
+    fflush (stdout);
+    return nprinted;
+}
+
+} // namespace cwiclo
+//}}}-------------------------------------------------------------------
@@ -0,0 +1,120 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2020 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC License.
+
+#pragma once
+#include "msg.h"
+#include "sysutil.h"
+
+//{{{ MsgTrace ---------------------------------------------------------
+
+namespace cwiclo {
+
+// Binary trace of dispatched messages, kept in a ring of fixed size
+// records in a shared file mapping. Records are written without locks
+// or formatting, so tracing can be left on in release builds, and the
+// file is readable while the process runs and after it crashes.
+// print decodes it in the format of the -d trace.
+//
+class MsgTrace {
+public:
+    enum : uint32_t {
+	Magic		= 'C'|'W'<<8|'T'<<16|'R'<<24,
+	Version		= 1,
+	DefaultRecords	= 64*1024,
+	DefaultNames	= 64*1024,	// bytes of method names
+	BodyPrefix	= 36		// most bytes of message body kept
+    };
+    //{{{2 Header ------------------------------------------------------
+    // At the start of the file, followed by the method name table
+    // and the record ring.
+    struct Header {
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	bodyprefix;	// body bytes kept in each record
+	uint32_t	nrecords;	// in the ring, a power of 2
+	uint32_t	namecap;	// bytes in the name table
+	uint64_t	nwritten;	// records; the next at nwritten % nrecords
+	uint32_t	nameused;	// bytes of the name table filled
+	uint32_t	pid;		// of the traced process
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 Record ------------------------------------------------------
+    struct Record {
+	uint64_t	time;		// steady_clock ns
+	uint64_t	method;		// methodid_t in the traced process
+	mrid_t		src;
+	mrid_t		dest;
+	uint32_t	size;		// of the whole body
+	uint32_t	seq;		// low bits of the record number, ~0 while written
+	uint8_t		body [BodyPrefix];
+    };
+    //}}}2--------------------------------------------------------------
+    // Each entry in the name table is the method pointer followed by
+    // the interface and method names, zero-terminated, padded to 8.
+public:
+    constexpr		MsgTrace (void)
+			    :_named(),_h(),_names(),_records(),_mapsz(),_nnamed(),_bodyprefix(),_mask() {}
+			~MsgTrace (void)	{ close(); }
+			MsgTrace (const MsgTrace&) = delete;
+    void		operator= (const MsgTrace&) = delete;
+    constexpr bool	is_open (void) const	{ return _h; }
+    bool		open (const char* filename, uint32_t nrecords = DefaultRecords, uint32_t bodyprefix = BodyPrefix);
+    void		close (void);
+    inline void		record (const Msg& msg);
+    static int		print (const char* filename);
+private:
+    void		add_name (methodid_t mid);
+    inline bool		is_named (methodid_t mid) const;
+private:
+    vector<methodid_t>	_named;		// open addressing set of methods in the name table
+    Header*		_h;
+    char*		_names;
+    Record*		_records;
+    size_t		_mapsz;
+    uint32_t		_nnamed;
+    uint32_t		_bodyprefix;
+    uint32_t		_mask;
+};
+
+//----------------------------------------------------------------------
+
+static inline auto msg_trace_name_hash (methodid_t mid)
+    { return uintptr_t(mid) * UINT64_C(0x9e3779b97f4a7c15); }
+
+bool MsgTrace::is_named (methodid_t mid) const
+{
+    if (_named.empty())
+	return false;
+    auto mask = _named.size()-1;
+    for (auto i = msg_trace_name_hash (mid) >> (64-log2p1(mask)); ; i = (i+1) & mask) {
+	if (_named[i] == mid)
+	    return true;
+	if (!_named[i])
+	    return false;
+    }
+}
+
+void MsgTrace::record (const Msg& msg)
+{
+    if (!is_named (msg.method()))
+	add_name (msg.method());
+    // Only this thread writes. Concurrent readers check seq to see if
+    // the record was complete, and nwritten for where the ring ends.
+    auto n = _h->nwritten;
+    auto& r = _records [n & _mask];
+    __atomic_store_n (&r.seq, UINT32_MAX, int(memory_order::relaxed));
+    __atomic_thread_fence (int(memory_order::release));
+    r.time = chrono::steady_clock::now();
+    r.method = uintptr_t (msg.method());
+    r.src = msg.src();
+    r.dest = msg.dest();
+    r.size = msg.size();
+    copy_n (msg.read().begin(), min (msg.size(), _bodyprefix), r.body);
+    __atomic_store_n (&r.seq, uint32_t(n), int(memory_order::release));
+    __atomic_store_n (&_h->nwritten, n+1, int(memory_order::release));
+}
+
+} // namespace cwiclo
+//}}}-------------------------------------------------------------------
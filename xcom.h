@@ -14,7 +14,14 @@ struct sockaddr;
 namespace cwiclo {
 
 class ICOM : public Interface {
-    DECLARE_INTERFACE (Interface, COM, (error,"s")(export,"s")(delete,""))
+    DECLARE_INTERFACE (Interface, COM, (error,"s")(export,"s")(delete,"")(ring,"h")(wake,"h")(methods,"ay"))
+public:
+    // Export list entry offering the shared memory ring transport.
+    // Not an interface name, so ignored by peers without the rings.
+    static constexpr const char RingsOption[] = "+rings";
+    // Export list entry asking for a COM.methods table in reply,
+    // which peers without method indexes would not understand.
+    static constexpr const char MethodsOption[] = "+methods";
 public:
     explicit		ICOM (mrid_t src)		: Interface (src) {}
     constexpr		ICOM (mrid_t src, mrid_t dest)	: Interface (src, dest) {}
@@ -40,7 +47,7 @@ public:
 			    msg.write() << errmsg;
 			    return msg;
 			}
-    static constexpr bool allowed_before_auth (methodid_t mid) { return mid == m_export(); }
+    static constexpr bool allowed_before_auth (methodid_t mid) { return mid == m_export() || mid == m_methods(); }
     static Msg		export_msg (const string_view& elstr) {
 			    Msg msg (Msg::Link{}, ICOM::m_export(), stream_sizeof(elstr), Msg::NoFdIncluded);
 			    msg.write() << elstr;
@@ -48,8 +55,22 @@ public:
 			}
     static auto		export_msg (const iid_t* elist)
 			    { return export_msg (string_from_interface_list (elist)); }
+    static Msg		methods_msg (const cmemlink& mtable) {
+			    Msg msg (Msg::Link{}, ICOM::m_methods(), stream_sizeof(mtable), Msg::NoFdIncluded);
+			    msg.write() << mtable;
+			    return msg;
+			}
     static auto		delete_msg (void)
 			    { return Msg (Msg::Link{}, m_delete(), 0, Msg::NoFdIncluded); }
+    static Msg		fd_msg (methodid_t mid, fd_t fd) {
+			    Msg msg (Msg::Link{}, mid, stream_sizeof(fd), 0);
+			    msg.write() << fd;
+			    return msg;
+			}
+    static auto		ring_msg (fd_t fd)	{ return fd_msg (m_ring(), fd); }
+    static auto		wake_msg (fd_t fd)	{ return fd_msg (m_wake(), fd); }
+    static constexpr bool is_ring (methodid_t mid)	{ return mid == m_ring(); }
+    static constexpr bool is_ring_setup (methodid_t mid) { return is_ring (mid) || mid == m_wake(); }
     template <typename O>
     inline static constexpr bool dispatch (O* o, const Msg& msg) {
 	if (msg.method() == m_error())
@@ -58,6 +79,10 @@ public:
 	    o->COM_export (msg.read().read<string_view>());
 	else if (msg.method() == m_delete())
 	    o->COM_delete ();
+	else if (msg.method() == m_methods())
+	    o->COM_methods (msg.read().read<cmemlink>());
+	// ring and wake are handled by Extern as they are read,
+	// because they change how the data after them is read.
 	else
 	    return Interface::dispatch (o, msg);
 	return true;
@@ -83,6 +108,9 @@ public:
 	mrid_t		extern_id;
 	SocketSide	side;
 	bool		is_connected;
+	bool		uses_rings;	// messages are exchanged through shared memory
+	uint32_t	nreads;		// recvmsg calls that read data
+	uint32_t	nreceived;	// messages read from the socket
     public:
 	constexpr auto is_importing (iid_t iid) const
 	    { return find (imported, iid); }
@@ -4,6 +4,10 @@
 // This file is free software, distributed under the ISC License.
 
 #include "xtern.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 
 //{{{ Extern -----------------------------------------------------------
 namespace cwiclo {
@@ -21,7 +25,19 @@ Extern::Extern (Msg::Link l)
 ,_einfo{}
 ,_bread (0)
 ,_inmsg()
-,_infd (-1)
+,_infds()
+,_noldfds (0)
+,_inmethods()
+,_outmethods()
+,_inbuf()
+,_inpos (0)
+,_ringtimer (msger_id(), msger_id())	// allocated when the rings open
+,_rout()
+,_rin()
+,_doorbell (-1)
+,_peerbell (-1)
+,_nplain (0)
+,_nfdspassed (0)
 {
     _relays.emplace_back (msger_id(), msger_id(), extid_COM);
 }
@@ -39,8 +55,20 @@ Extern::~Extern (void)
 
 void Extern::queue_outgoing (Msg&& msg, extid_t extid)
 {
-    _outq.emplace_back (move(msg), extid);
-    Timer_timer (_sockfd);
+    if (msg.size() > ExtMsg::MaxBodySize)
+	return error ("%s.%s message is too large to export", msg.interface(), msg.method());
+    // Messages passing fds need the fd offset in the header
+    uint16_t mi = ExtMsg::NoMethodIndex;
+    if (msg.fd_offset() == Msg::NoFdIncluded)
+	mi = method_index (msg.method());
+    _outq.emplace_back (move(msg), extid, mi);
+    // Writing to the ring needs no socket read,
+    // and the socket watch only changes when blocked.
+    if (_rout.is_open() && !_nplain) {
+	if (_sockfd >= 0 && write_outgoing())
+	    _timer.wait_rdWr (_sockfd);
+    } else
+	Timer_timer (_sockfd);
 }
 
 Extern::PRelay* Extern::prelay_by_id (mrid_t id)
@@ -89,12 +117,20 @@ void Extern::requeue_pending (void)
 //}}}-------------------------------------------------------------------
 //{{{ Extern::ExtMsg
 
-Extern::ExtMsg::ExtMsg (Msg&& msg, extid_t extid)
+Extern::ExtMsg::ExtMsg (Msg&& msg, extid_t extid, uint16_t mindex)
 :_body (msg.move_body())
-,_h { ceilg (_body.size(), Msg::Alignment::Body), extid, msg.fd_offset(), write_header_strings(msg.method()) }
+,_h { Header::pack (ceilg (_body.size(), Msg::Alignment::Body), msg.fd_count(), mindex != NoMethodIndex), extid, {} }
 {
-    assert (_body.capacity() >= _h.sz && "message body must be created aligned to Msg::Alignment::Body");
-    _body.shrink (_h.sz);
+    if (_h.indexed())
+	_h.mindex = mindex;
+    else {
+	_h.fdoffset = msg.fd_offset();
+	_h.hsz = write_header_strings (msg.method());
+    }
+    assert (_body.capacity() >= body_size() && "message body must be created aligned to Msg::Alignment::Body");
+    assert (_body.size() <= MaxBodySize && "Extern must reject messages too large to export");
+    assert (msg.fd_count() <= MaxFds && "too many fds passed in one message");
+    _body.shrink (body_size());
 }
 
 uint8_t Extern::ExtMsg::write_header_strings (methodid_t method)
@@ -114,7 +150,7 @@ void Extern::ExtMsg::write_iovecs (iovec* iov, streamsize bw)
     // Setup the two iovecs, 0 for header, 1 for body
     // bw is the bytes already written in previous sendmsg call
     auto hp = header_ptr();	// char* to full header
-    auto hsz = _h.hsz + sizeof(_h)*!_h.hsz;
+    auto hsz = header_size();
     if (bw < hsz) {	// still need to write header
 	hsz -= bw;
 	hp += bw;
@@ -127,7 +163,30 @@ void Extern::ExtMsg::write_iovecs (iovec* iov, streamsize bw)
     iov[0].iov_base = hp;
     iov[0].iov_len = hsz;
     iov[1].iov_base = _body.iat(bw);
-    iov[1].iov_len = _h.sz - bw;
+    iov[1].iov_len = body_size() - bw;
+}
+
+// Takes the fds passed with this message from the front of fds,
+// writing them into the body.
+void Extern::ExtMsg::receive_fds (vector<fd_t>& fds)
+{
+    assert (fds.size() >= fd_count() && "the fds for this message must be received with its header");
+    for (auto i = 0u; i < _h.nfds(); ++i)
+	ostream (_body.iat(_h.fdoffset+i*sizeof(fd_t)), sizeof(fd_t)) << fds[i];
+    fds.erase (fds.begin(), fd_count());
+}
+
+void Extern::ExtMsg::write_passed_fds (ostream& os) const
+{
+    for (auto i = 0u; i < _h.nfds(); ++i)
+	os << passed_fd (i);
+}
+
+// Passed fds are closed once sent
+void Extern::ExtMsg::close_passed_fds (void) const
+{
+    for (auto i = 0u; i < _h.nfds(); ++i)
+	close (passed_fd (i));
 }
 
 methodid_t Extern::ExtMsg::parse_method (void)
@@ -152,8 +211,8 @@ methodid_t Extern::ExtMsg::parse_method (void)
 void Extern::ExtMsg::debug_dump (void) const
 {
     if (debug_tracing_on()) {
-	debug_printf ("[X] Incoming message for extid %u of size %u = {""{{\n", _h.extid, _h.sz);
-	hexdump (header_ptr(), _h.hsz);
+	debug_printf ("[X] Incoming message for extid %u of size %u = {""{{\n", _h.extid, body_size());
+	hexdump (header_ptr(), header_size());
 	hexdump (_body);
 	debug_printf ("}""}}\n");
     }
@@ -178,7 +237,11 @@ void Extern::Extern_open (fd_t fd, const iid_t* eifaces, IExtern::SocketSide sid
 	return error_libc ("O_NONBLOCK");
 
     // Initial handshake is an exchange of COM::export messages
-    queue_outgoing (ICOM::export_msg (eifaces), extid_COM);
+    auto elist = ICOM::string_from_interface_list (eifaces);
+    if (App::instance().extern_rings())
+	elist.appendf ("%s%s", elist.empty() ? "" : ",", ICOM::RingsOption);
+    elist.appendf ("%s%s", elist.empty() ? "" : ",", ICOM::MethodsOption);
+    queue_outgoing (ICOM::export_msg (elist), extid_COM);
 }
 
 void Extern::Extern_close (void)
@@ -186,12 +249,52 @@ void Extern::Extern_close (void)
     requeue_pending();
     set_unused();
     _einfo.is_connected = false;
-    if (_infd >= 0)
-	close (exchange (_infd, -1));
+    _einfo.uses_rings = false;
+    _rout.close();
+    _rin.close();
+    if (_doorbell >= 0)
+	close (exchange (_doorbell, -1));
+    if (_peerbell >= 0)
+	close (exchange (_peerbell, -1));
+    for (auto fd : _infds)
+	close (fd);
+    _infds.clear();
+    _noldfds = 0;
+    _inbuf.deallocate();
+    _inpos = 0;
     if (_sockfd >= 0)
 	close (exchange (_sockfd, -1));
 }
 
+// The method table sent to the other side lists the methods this side
+// accepts, those of imported and exported interfaces, in index order.
+// Each interface is its name, then the name and signature of each of
+// its methods, then an empty string.
+memblock Extern::create_method_table (void)
+{
+    memblock mtable;
+    _inmethods.clear();
+    for (auto il : {App::imports(), App::exports()}) {
+	for (auto i = il; i && *i; ++i) {
+	    mtable.append (*i, interface_name_size (*i));
+	    for (auto m = interface_first_method (*i); method_next_offset (m) && _inmethods.size() < ExtMsg::NoMethodIndex; m += method_next_offset (m)) {
+		mtable.append (m, method_name_size (m));
+		_inmethods.push_back (m);
+	    }
+	    mtable.append ("", 1);
+	}
+    }
+    return mtable;
+}
+
+uint16_t Extern::method_index (methodid_t mid) const
+{
+    auto i = lower_bound (_outmethods, MethodIndex { mid, 0 });
+    if (i < _outmethods.end() && i->method == mid)
+	return i->index;
+    return ExtMsg::NoMethodIndex;
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ Extern::COM
 
@@ -206,12 +309,15 @@ void Extern::COM_export (string elist)
     // Other side of the socket listing exported interfaces as a comma-separated list
     _einfo.is_connected = true;
     _einfo.imported.clear();
+    bool rings = false, methods = false;
     debug_printf ("[X] %hu.Extern receives import list:", msger_id());
     foreach (ei, elist) {
 	auto eic = elist.find (',', ei);
 	if (!eic)
 	    eic = elist.end();
 	*eic = 0;
+	rings |= !strcmp (ei, ICOM::RingsOption);
+	methods |= !strcmp (ei, ICOM::MethodsOption);
 	auto iid = App::instance().extern_interface_by_name (ei, eic+1-ei);
 	if (iid) {	// _einfo.imported only contains interfaces supported by this App
 	    debug_printf (" %s", iid);
@@ -220,9 +326,41 @@ void Extern::COM_export (string elist)
 	ei = eic;
     }
     debug_printf ("\n");
+    // The method table is sent only to peers that can read it
+    if (methods)
+	queue_outgoing (ICOM::methods_msg (create_method_table()), extid_COM);
+    // When both sides offer the rings, each writes its own
+    if (rings && App::instance().extern_rings()) {
+	open_rings();
+	Timer_timer (_sockfd);
+    }
     requeue_pending();
 }
 
+// The other side's method table gives the index to send with each
+// method it lists. Methods not in it are sent with header strings.
+void Extern::COM_methods (const cmemlink& mtable)
+{
+    _outmethods.clear();
+    if (mtable.empty())
+	return;
+    auto& app = App::instance();
+    uint16_t mi = 0;
+    for (auto i = zstr::in (mtable.data(), mtable.size()); i && mi < ExtMsg::NoMethodIndex; ++i) {
+	auto ifacename = *i;
+	auto iface = app.extern_interface_by_name (ifacename, *++i - ifacename);
+	for (; i && **i && mi < ExtMsg::NoMethodIndex; ++mi) {
+	    auto mname = *i;
+	    auto mend = *(i += 2);	// past the signature
+	    if (auto mid = iface ? interface_lookup_method (iface, mname, mend-mname) : nullptr) {
+		MethodIndex e = { mid, mi };
+		_outmethods.insert (lower_bound (_outmethods, e), e);
+	    }
+	}
+    }
+    debug_printf ("[X] %hu.Extern indexes %u of %hu methods\n", msger_id(), _outmethods.size(), mi);
+}
+
 void Extern::COM_delete (void)
 {
     // This happens when the Extern Msger on the other side of the socket dies
@@ -232,15 +370,29 @@ void Extern::COM_delete (void)
 //}}}-------------------------------------------------------------------
 //{{{ Extern::Timer
 
-void Extern::Timer_timer (fd_t)
+void Extern::Timer_timer (fd_t fd)
 {
-    if (_sockfd >= 0)
+    // The doorbell rings when the other side wrote to the ring, or made
+    // space in it. The socket watch is then left alone unless blocked.
+    bool ringing = fd >= 0 && fd == _doorbell;
+    if (ringing) {
+	// Reset before reading, so that a later ring is not missed
+	uint64_t n;
+	if (0 > read (_doorbell, &n, sizeof(n)) && errno != EAGAIN)
+	    return error_libc ("eventfd read");
+    } else if (_sockfd >= 0)
 	read_incoming();
+    if (_sockfd >= 0 && is_reading_ring() && !read_ring()) {
+	error ("invalid message");
+	return Extern_close();
+    }
     auto tcmd = ITimer::WatchCmd::Read;
     if (_sockfd >= 0 && write_outgoing())
 	tcmd = ITimer::WatchCmd::ReadWrite;
-    if (_sockfd >= 0)
+    if (_sockfd >= 0 && (!ringing || tcmd != ITimer::WatchCmd::Read))
 	_timer.watch (tcmd, _sockfd);
+    if (ringing && _doorbell >= 0)
+	_ringtimer.wait_read (_doorbell);
 }
 
 //{{{2 write_outgoing ---------------------------------------------------
@@ -250,30 +402,47 @@ bool Extern::write_outgoing (void)
 {
     // write all queued messages
     while (!_outq.empty()) {
+	// With the ring open, only messages marked by _nplain go to the socket
+	if (_rout.is_open() && !_nplain && (!write_ring() || _outq.empty()))
+	    return false;	// done, or waiting for space on the doorbell
+
 	// Build sendmsg header
 	msghdr mh = {};
 
-	// Add fd if being passed
-	int passedfd = _outq.front().passed_fd();
-	char fdbuf [CMSG_SPACE(sizeof(passedfd))] = {};
-	unsigned nm = (passedfd >= 0);
-	if (nm && !_bwritten) {	// only the first write passes the fd
+	// See how many messages can be written at once. The fds of all
+	// are passed together, with the first byte written, limited by
+	// how many the kernel accepts in one sendmsg call.
+	enum { MAX_MSGS_PER_SEND = 32 };
+	auto maxnm = min (_outq.size(), MAX_MSGS_PER_SEND);
+	if (_rout.is_open())
+	    maxnm = min (maxnm, _nplain);
+	auto nm = 0u, nfds = 0u;
+	for (; nm < maxnm; ++nm) {
+	    auto mfds = nm < _nfdspassed ? 0u : _outq[nm].fd_count();
+	    // New fds are passed only after all messages claiming the
+	    // ones passed before are written, so that the other side
+	    // can tell when passed fds are left unclaimed.
+	    if (mfds && _nfdspassed)
+		break;
+	    if (nfds + mfds > ExtMsg::MaxFdsPerSend)
+		break;
+	    nfds += mfds;
+	}
+
+	// Add fds if being passed
+	char fdbuf [CMSG_SPACE(ExtMsg::MaxFdsPerSend*sizeof(fd_t))] = {};
+	if (nfds) {
 	    mh.msg_control = fdbuf;
-	    mh.msg_controllen = sizeof(fdbuf);
+	    mh.msg_controllen = CMSG_SPACE(nfds*sizeof(fd_t));
 	    auto cmsg = CMSG_FIRSTHDR(&mh);
-	    cmsg->cmsg_len = sizeof(fdbuf);
+	    cmsg->cmsg_len = CMSG_LEN(nfds*sizeof(fd_t));
 	    cmsg->cmsg_level = SOL_SOCKET;
 	    cmsg->cmsg_type = SCM_RIGHTS;
-	    ostream (CMSG_DATA (cmsg), sizeof(passedfd)) << passedfd;
+	    ostream os (CMSG_DATA (cmsg), nfds*sizeof(fd_t));
+	    for (auto m = _nfdspassed; m < nm; ++m)
+		_outq[m].write_passed_fds (os);
 	}
 
-	// See how many messages can be written at once, limited by fd passing.
-	// Can only pass one fd per sendmsg call, but can aggregate the rest.
-	enum { MAX_MSGS_PER_SEND = 32 };
-	auto maxnm = min (_outq.size(), MAX_MSGS_PER_SEND);
-	while (nm < maxnm && !_outq[nm].has_fd())
-	    ++nm;
-
 	// Create iovecs for output
 	iovec iov [2*MAX_MSGS_PER_SEND];
 	mh.msg_iov = iov;
@@ -298,15 +467,17 @@ bool Extern::write_outgoing (void)
 	    _bwritten += smr;
 	}
 
-	// Close the fd once successfully passed
-	if (passedfd >= 0)
-	    close (passedfd);
+	// Close the fds once successfully passed
+	for (; _nfdspassed < nm; ++_nfdspassed)
+	    _outq[_nfdspassed].close_passed_fds();
 
 	// Erase messages that have been fully written
 	auto ndone = 0u;
 	for (; ndone < nm && _bwritten >= _outq[ndone].size(); ++ndone)
 	    _bwritten -= _outq[ndone].size();
 	_outq.erase (_outq.begin(), ndone);
+	_nplain -= min (_nplain, ndone);
+	_nfdspassed -= ndone;
 
 	assert (((_outq.empty() && !_bwritten) || (_bwritten < _outq.front().size()))
 		&& "_bwritten must now be equal to bytes written from first message in queue");
@@ -319,28 +490,33 @@ bool Extern::write_outgoing (void)
 
 void Extern::read_incoming (void)
 {
+    if (!_inbuf.capacity())
+	_inbuf.reserve (InbufSize);
     for (;;) {	// Read until EAGAIN
 	// Create iovecs for input
-	// There are three of them, representing the header and the body
-	// of each message, plus the fixed header of the next. The common
-	// case is to read the variable parts and the fixed header of the
-	// next message in each recvmsg call.
-	ExtMsg::Header fh = {};
-	iovec iov[3] = {{},{},{&fh,sizeof(fh)}};
-	_inmsg.write_iovecs (iov, _bread);
-
-	// Ancillary space for fd and credentials
-	char cmsgbuf [CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(ucred))] = {};
+	// Messages are read into _inbuf, as many as fit in one recvmsg
+	// call, and copied out of it. A message too large for it is read
+	// directly into its own body, with the bytes after it into _inbuf.
+	iovec iov[3] = {};
+	if (_inmsg.header_size())
+	    _inmsg.write_iovecs (iov, _bread);
+	_inbuf.erase (_inbuf.begin(), _inpos);	// move the partial message to the front
+	_inpos = 0;
+	iov[2] = { _inbuf.end(), _inbuf.capacity() - _inbuf.size() };
+
+	// Ancillary space for fds and credentials
+	char cmsgbuf [CMSG_SPACE(ExtMsg::MaxFdsPerSend*sizeof(int)) + CMSG_SPACE(sizeof(ucred))] = {};
 
 	// Build struct for recvmsg
 	msghdr mh = {};
 	mh.msg_iov = iov;
-	mh.msg_iovlen = 2 + (_bread >= sizeof(fh));	// read another header only when already have one
+	mh.msg_iovlen = size(iov);
 	mh.msg_control = cmsgbuf;
 	mh.msg_controllen = sizeof(cmsgbuf);
 
 	// Receive some data
-	if (auto rmr = recvmsg (_sockfd, &mh, 0); rmr <= 0 || (mh.msg_flags & (MSG_CTRUNC|MSG_TRUNC))) {
+	auto rmr = recvmsg (_sockfd, &mh, 0);
+	if (rmr <= 0 || (mh.msg_flags & (MSG_CTRUNC|MSG_TRUNC))) {
 	    if (!rmr || errno == ECONNRESET)	// br == 0 when remote end closes. No error then, just need to close this end too.
 		debug_printf ("[X] %hu.Extern: rsocket %d closed by the other end\n", msger_id(), _sockfd);
 	    else if (errno == EINTR)
@@ -350,10 +526,10 @@ void Extern::read_incoming (void)
 	    else
 		error_libc ("recvmsg");
 	    return Extern_close();
-	} else {
-	    debug_printf ("[X] %hu.Extern: read %ld bytes from socket %d\n", msger_id(), rmr, _sockfd);
-	    _bread += rmr;
 	}
+	debug_printf ("[X] %hu.Extern: read %ld bytes from socket %d\n", msger_id(), rmr, _sockfd);
+	++_einfo.nreads;
+	streamsize br = rmr;
 
 	// Check if ancillary data was passed
 	for (auto cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
@@ -366,68 +542,99 @@ void Extern::read_incoming (void)
 		    debug_printf ("[X] Received credentials: pid=%u,uid=%u,gid=%u\n", _einfo.creds.pid, _einfo.creds.uid, _einfo.creds.gid);
 		}
 	    } else if (cmsg->cmsg_type == SCM_RIGHTS) {
+		// The fds may arrive with the data before that of their
+		// messages, and are given to them in order as they are read.
+		// The messages claiming the fds passed before precede them,
+		// and must all be parsed by the end of this read.
+		_noldfds = _infds.size();
 		istream cis (CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
 		while (cis.remaining() >= sizeof(int)) {
-		    if (_infd >= 0) {
-			debug_printf ("[XE] Closing extra fd %d\n", _infd);
-			close (_infd);
-			error ("multiple file descriptors in one message");
-		    }
-		    _infd = cis.read<int>();
+		    _infds.push_back (cis.read<int>());
+		    debug_printf ("[X] Received fd %d\n", _infds.back());
 		}
-		debug_printf ("[X] Received fd %d\n", _infd);
 	    }
 	}
 
-	// If the read message is complete, validate it and queue for delivery
-	if (_bread >= _inmsg.size()) {
-	    _bread -= _inmsg.size();
-	    _inmsg.debug_dump();
-
-	    // write the passed fd into the body
-	    if (_inmsg.has_fd()) {
-		assert (_infd >= 0 && "_infd magically disappeared since header check");
-		_inmsg.set_passed_fd (exchange (_infd, -1));
-	    }
-
-	    if (!accept_incoming_message()) {
-		error ("invalid message");
+	// Finish the large message, if reading one
+	if (_inmsg.header_size()) {
+	    auto nr = min (br, _inmsg.size() - _bread);
+	    _bread += nr;
+	    br -= nr;
+	    if (_bread >= _inmsg.size() && !finish_incoming_message())
 		return Extern_close();
-	    }
-
-	    // Copy the fixed header of the next message
-	    _inmsg.set_header (fh);
-	    assert (_bread <= sizeof(fh) && "recvmsg read unrequested data");
 	}
-	// Here, a message has been accepted, or there was no message,
-	// and there is a partially or fully read fixed header of another.
-
-	// Now can check if fixed header is valid
-	if (_bread == sizeof(fh)) {
-	    auto& h = _inmsg.header();
-	    if (h.hsz < ExtMsg::MinHeaderSize
-		    || !divisible_by (h.hsz, Msg::Alignment::Header)
-		    || !divisible_by (h.sz, Msg::Alignment::Body)
-		    || h.sz > ExtMsg::MaxBodySize
-		    || (h.fdoffset != Msg::NoFdIncluded
-			&& (_infd < 0	// the fd must be passed at this point
-			    || h.fdoffset+sizeof(_infd) > h.sz
-			    || !divisible_by (h.fdoffset, Msg::Alignment::Fd)))
-		    || h.extid > extid_ServerLast) {
+	_inbuf.shrink (_inbuf.size() + br);
+
+	// Then the messages in _inbuf
+	while (!_inmsg.header_size()) {
+	    ExtMsg::Header h;
+	    auto avail = _inbuf.size() - _inpos;
+	    if (avail < streamsize(sizeof(h)))
+		break;
+	    copy_n (_inbuf.iat(_inpos), sizeof(h), pointer_cast<char>(&h));
+	    if (!ExtMsg::is_valid_header (h)
+		    || _infds.size() < ExtMsg::fd_count (h)	// the fds must be passed at this point
+		    || (_noldfds && _noldfds < ExtMsg::fd_count (h))) {	// and not split between batches
 		error ("invalid message");
 		return Extern_close();
 	    }
-	    _inmsg.allocate_body (h.sz);
+	    _inmsg.set_header (h);
+	    auto msz = _inmsg.size();
+	    if (avail < msz && msz <= _inbuf.capacity()/4) {
+		_inmsg.set_header ({});
+		break;	// wait for the rest of a small message in _inbuf
+	    }
+	    _inmsg.allocate_body (_inmsg.body_size());
+	    iovec miov[2];
+	    _inmsg.write_iovecs (miov, 0);
+	    auto nc = min (avail, msz);
+	    for (auto& i : miov) {
+		auto n = min (nc, streamsize(i.iov_len));
+		copy_n (_inbuf.iat(_inpos), n, static_cast<char*>(i.iov_base));
+		_inpos += n;
+		nc -= n;
+	    }
+	    _bread = min (avail, msz);
+	    if (_bread >= msz && !finish_incoming_message())
+		return Extern_close();
+	}
+	// Here, all complete messages have been accepted, and there may be
+	// a partially read one, either in _inbuf or in _inmsg.
+	if (_noldfds) {
+	    error ("passed fds were not claimed by any message");
+	    return Extern_close();
 	}
     }
 }
 
-bool Extern::accept_incoming_message (void)
+// Accepts the fully read _inmsg, and resets it for the next message.
+// Returns false if the message is invalid, and the connection must close.
+bool Extern::finish_incoming_message (void)
+{
+    // write the passed fds into the body
+    _noldfds -= min (_noldfds, _inmsg.fd_count());
+    _inmsg.receive_fds (_infds);
+    _inmsg.debug_dump();
+    // Once the other side writes to the ring, its socket messages
+    // have marker frames there in their place, after which they are
+    // accepted, to keep the order in which they were sent.
+    auto ok = (!is_reading_ring() || read_ring (true))
+		&& accept_incoming_message (_inmsg);
+    if (ok)
+	++_einfo.nreceived;
+    else
+	error ("invalid message");
+    _inmsg.set_header ({});
+    _bread = 0;
+    return ok;
+}
+
+bool Extern::accept_incoming_message (ExtMsg& m)
 {
     // Validate the message using method signature
-    auto method = _inmsg.parse_method();
+    auto method = m.header().indexed() ? method_by_index (m.header().mindex) : m.parse_method();
     if (!method) {
-	debug_printf ("[XE] Incoming message has invalid header strings\n");
+	debug_printf ("[XE] Incoming message has invalid method\n");
 	return false;
     }
     if (info().filter_uid
@@ -436,16 +643,22 @@ bool Extern::accept_incoming_message (void)
 	debug_printf ("[XE] Incoming message %s.%s from process %u with uid %u is disallowed by filter_uid %u\n", interface_of_method(method), method, info().creds.pid, info().creds.uid, info().filter_uid);
 	return false;
     }
-    auto msgis = _inmsg.read();
+    auto msgis = m.read();
     auto vsz = Msg::validate_signature (msgis, signature_of_method (method));
-    if (ceilg (vsz, Msg::Alignment::Body) != _inmsg.body_size()) {
+    if (ceilg (vsz, Msg::Alignment::Body) != m.body_size()) {
 	debug_printf ("[XE] Incoming message body failed validation\n");
 	return false;
     }
-    _inmsg.trim_body (vsz);	// Local messages store unpadded size
+    if (m.has_fd() && m.header().nfds() != Msg::fd_count (signature_of_method (method))) {
+	debug_printf ("[XE] Incoming message passes %u fds instead of one for each h in its signature\n", m.header().nfds());
+	return false;
+    }
+    m.trim_body (vsz);	// Local messages store unpadded size
+    if (ICOM::is_ring_setup (method))
+	return accept_ring_setup (method, m);
 
     // Lookup or create local relay
-    auto rp = prelay_by_extid (_inmsg.extid());
+    auto rp = prelay_by_extid (m.extid());
     if (!rp) {
 	// Verify that the requested interface is on the exported list
 	if (!_einfo.is_exporting (interface_of_method (method))) {
@@ -453,12 +666,12 @@ bool Extern::accept_incoming_message (void)
 	    return false;
 	}
 	// Verify that the other side sets extid correctly
-	if (bool(_einfo.side) ^ (_inmsg.extid() < extid_ServerBase)) {
+	if (bool(_einfo.side) ^ (m.extid() < extid_ServerBase)) {
 	    debug_printf ("[XE] Extern connection peer allocates incorrect extids\n");
 	    return false;
 	}
-	debug_printf ("[X] Creating new extid link %hu with interface %s\n", _inmsg.extid(), interface_of_method (method));
-	rp = &_relays.emplace_back (msger_id(), _inmsg.extid());
+	debug_printf ("[X] Creating new extid link %hu with interface %s\n", m.extid(), interface_of_method (method));
+	rp = &_relays.emplace_back (msger_id(), m.extid());
 	//
 	// Create a COMRelay as the destination. It will then create the
 	// actual server Msger using the interface in the message.
@@ -466,10 +679,316 @@ bool Extern::accept_incoming_message (void)
     }
 
     // Create local message from ExtMsg and forward it to the COMRelay
-    rp->relay.forward_msg (method, _inmsg.move_body(), _inmsg.fd_offset(), _inmsg.extid());
+    rp->relay.forward_msg (method, m.move_body(), m.fd_offset(), m.extid());
     return true;
 }
 //}}}2
+//{{{2 Shared memory rings
+
+// Creates the ring this side writes and the doorbell it waits on, and
+// passes them to the other side. Messages queued after them go to the
+// ring. On failure, the connection keeps using the socket.
+void Extern::open_rings (void)
+{
+    if (_rout.is_open())
+	return;
+    fd_t ringfd = _rout.create(), bellfd = -1;
+    if (ringfd >= 0 && 0 <= (_doorbell = eventfd (0, EFD_NONBLOCK| EFD_CLOEXEC)))
+	bellfd = fcntl (_doorbell, F_DUPFD_CLOEXEC, 0);	// passed fds are closed when sent
+    if (bellfd < 0) {
+	debug_printf ("[XE] %hu.Extern failed to create rings: %s\n", msger_id(), strerror(errno));
+	if (ringfd >= 0)
+	    close (ringfd);
+	if (_doorbell >= 0)
+	    close (exchange (_doorbell, -1));
+	return _rout.close();
+    }
+    debug_printf ("[X] %hu.Extern switching to rings\n", msger_id());
+    if (_ringtimer.dest() == msger_id())
+	_ringtimer.allocate_id();
+    _outq.emplace_back (ICOM::ring_msg (ringfd), extid_COM);
+    _outq.emplace_back (ICOM::wake_msg (bellfd), extid_COM);
+    _nplain = _outq.size();
+    _einfo.uses_rings = is_reading_ring();
+    _ringtimer.wait_read (_doorbell);
+}
+
+// The other side passes the ring it writes, and then the doorbell it
+// waits on. The ring is read from then on, with messages after wake
+// on the socket ordered by marker frames. Only offered rings are accepted.
+bool Extern::accept_ring_setup (methodid_t method, ExtMsg& m)
+{
+    auto fd = m.passed_fd();
+    auto ok = m.extid() == extid_COM && App::instance().extern_rings();
+    if (ICOM::is_ring (method)) {
+	ok = ok && !_rin.is_open() && _rin.attach (fd);
+	close (fd);
+	// The ring may be read before the export list opening the rings
+	// on this side is dispatched. The doorbell timer id is allocated
+	// here then, so that it does not depend on that order.
+	if (ok && _ringtimer.dest() == msger_id())
+	    _ringtimer.allocate_id();
+    } else if ((ok = ok && _rin.is_open() && !is_reading_ring())) {
+	debug_printf ("[X] %hu.Extern reading ring\n", msger_id());
+	_peerbell = fd;
+	_einfo.uses_rings = _rout.is_open();
+	// The other side may already be waiting for what was written
+	if (_rout.is_open() && _rout.take_waiting_consumer())
+	    ring_doorbell();
+    } else
+	close (fd);
+    if (!ok)
+	debug_printf ("[XE] Unexpected %s message\n", method);
+    return ok;
+}
+
+void Extern::ring_doorbell (void)
+{
+    uint64_t one = 1;
+    if (0 > write (_peerbell, &one, sizeof(one)) && errno != EAGAIN)
+	error_libc ("eventfd write");
+}
+
+// Writes messages from the front of _outq to the ring. A message that
+// can not go there, because it passes an fd or is too large, is left
+// for the socket, with a marker frame in the ring in its place.
+// Returns false when waiting for space.
+bool Extern::write_ring (void)
+{
+    ExtMsg::Header marker = {};	// hsz 0 is never a message
+    auto nw = 0u;
+    while (nw < _outq.size() && !_nplain) {
+	auto& m = _outq[nw];
+	auto tosocket = m.fd_count() || m.size() > _rout.capacity()/4;
+	iovec iov[2];
+	if (tosocket)
+	    iov[0] = { &marker, sizeof(marker) };
+	else
+	    m.write_iovecs (iov, 0);
+	if (_rout.write (iov, 2-tosocket)) {
+	    if (tosocket)
+		_nplain = 1;
+	    else
+		++nw;
+	} else if (_rout.wait_for_space (tosocket ? sizeof(marker) : m.size()))
+	    break;
+    }
+    _outq.erase (_outq.begin(), nw);
+    if (nw)
+	debug_printf ("[X] Wrote %u messages to ring\n", nw);
+    if (_peerbell >= 0 && _rout.take_waiting_consumer())
+	ring_doorbell();
+    return _outq.empty() || _nplain;
+}
+
+// Reads messages from the ring until it is empty, or has a marker frame
+// for a socket message that has not yet been read. With tomarker, that
+// message has been read, and the marker must be there to be consumed.
+// Returns false on invalid data.
+bool Extern::read_ring (bool tomarker)
+{
+    ExtMsg m;
+    auto nr = 0u;
+    for (ExtMsg::Header h;;) {
+	auto avail = _rin.available();
+	if (!avail) {
+	    if (tomarker)
+		return false;	// the marker is written before the socket message
+	    if (_rin.wait_for_data())
+		break;		// on the doorbell
+	    continue;
+	}
+	if (avail < streamsize(sizeof(h)))
+	    return false;
+	_rin.peek (&h, sizeof(h));
+	if (ExtMsg::is_marker (h)) {
+	    if (tomarker) {
+		_rin.skip (sizeof(h));
+		++nr;
+	    }
+	    break;
+	}
+	if (!ExtMsg::is_valid_header (h)
+		|| ExtMsg::fd_count (h)	// those are written to the socket
+		|| avail < ExtMsg::header_size (h) + streamsize(h.sz()))
+	    return false;
+	// The fixed header is not read again, since the other side
+	// could change it after validation. Only the header strings
+	// and the body are copied from the ring.
+	m.set_header (h);
+	m.allocate_body (h.sz());
+	iovec iov[2];
+	m.write_iovecs (iov, sizeof(h));
+	_rin.skip (sizeof(h));
+	_rin.read (iov, size(iov));
+	m.debug_dump();
+	if (!accept_incoming_message (m))
+	    return false;
+	++nr;
+    }
+    if (nr && _rin.take_waiting_producer())
+	ring_doorbell();
+    return true;
+}
+
+//}}}2
+//}}}-------------------------------------------------------------------
+//{{{ Extern::ShmRing
+
+// Creates the ring in a sealed memfd, returning the memfd to pass to
+// the other side, or -1 on failure, with errno set.
+Msg::fd_t Extern::ShmRing::create (streamsize sz)
+{
+    close();
+    sz = ceil2 (max (sz, streamsize(MinSize)));
+    fd_t fd = memfd_create ("cwiclo-ring", MFD_CLOEXEC| MFD_ALLOW_SEALING);
+    if (fd >= 0 && (0 > ftruncate (fd, sizeof(Control)+sz)
+		    || 0 > fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK| F_SEAL_GROW| F_SEAL_SEAL)
+		    || !map (fd, sz)))
+	::close (exchange (fd, -1));
+    return fd;
+}
+
+// Maps the ring created by the other side. The seals are checked to
+// ensure it can not be truncated while mapped. fd is not closed.
+bool Extern::ShmRing::attach (fd_t fd)
+{
+    close();
+    struct stat st;
+    if (0 > fstat (fd, &st) || st.st_size < streamsize(sizeof(Control)))
+	return false;
+    streamsize sz = st.st_size - sizeof(Control);
+    auto seals = fcntl (fd, F_GET_SEALS);
+    return sz >= MinSize && sz <= Msg::MaxSize && !(sz & (sz-1))
+	&& seals >= 0 && (seals & F_SEAL_SHRINK)
+	&& map (fd, sz);
+}
+
+bool Extern::ShmRing::map (fd_t fd, streamsize sz)
+{
+    auto p = mmap (nullptr, sizeof(Control)+sz, PROT_READ| PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+	return false;
+    _c = static_cast<Control*>(p);
+    _data = pointer_cast<char>(_c+1);
+    _pos = 0;
+    _mask = sz-1;
+    return true;
+}
+
+void Extern::ShmRing::close (void)
+{
+    if (_c)
+	munmap (exchange (_c, nullptr), sizeof(Control)+capacity());
+    _data = nullptr;
+    _pos = 0;
+    _mask = 0;
+}
+
+//----------------------------------------------------------------------
+// The producer side
+
+streamsize Extern::ShmRing::space (void) const
+{
+    auto used = _pos - __atomic_load_n (&_c->tail, int(memory_order::acquire));
+    return used > uint64_t(capacity()) ? 0 : capacity()-used;
+}
+
+// Writes all of iov, or nothing when there is not enough space
+bool Extern::ShmRing::write (const iovec* iov, unsigned n)
+{
+    streamsize sz = 0;
+    for (auto i = 0u; i < n; ++i)
+	sz += iov[i].iov_len;
+    if (space() < sz)
+	return false;
+    for (auto i = 0u; i < n; ++i) {
+	auto p = static_cast<const char*>(iov[i].iov_base);
+	for (streamsize left = iov[i].iov_len; left;) {
+	    auto o = _pos & _mask;
+	    auto nc = min (left, streamsize(capacity()-o));
+	    copy_n (p, nc, _data+o);
+	    p += nc;
+	    left -= nc;
+	    _pos += nc;
+	}
+    }
+    __atomic_store_n (&_c->head, _pos, int(memory_order::release));
+    return true;
+}
+
+// Marks the producer waiting for n bytes of space on its doorbell,
+// unless the space was made in the meantime. Returns true when waiting.
+bool Extern::ShmRing::wait_for_space (streamsize n)
+{
+    __atomic_store_n (&_c->producer_waiting, 1, int(memory_order::relaxed));
+    __atomic_thread_fence (int(memory_order::seq_cst));
+    if (space() < n)
+	return true;
+    __atomic_store_n (&_c->producer_waiting, 0, int(memory_order::relaxed));
+    return false;
+}
+
+//----------------------------------------------------------------------
+// The consumer side
+
+streamsize Extern::ShmRing::available (void) const
+{
+    auto n = __atomic_load_n (&_c->head, int(memory_order::acquire)) - _pos;
+    return min (n, uint64_t(capacity()));
+}
+
+void Extern::ShmRing::copy_out (uint64_t pos, void* p, streamsize n) const
+{
+    for (auto op = static_cast<char*>(p); n;) {
+	auto o = pos & _mask;
+	auto nc = min (n, streamsize(capacity()-o));
+	copy_n (_data+o, nc, op);
+	op += nc;
+	n -= nc;
+	pos += nc;
+    }
+}
+
+void Extern::ShmRing::peek (void* p, streamsize n) const
+    { copy_out (_pos, p, n); }
+
+void Extern::ShmRing::skip (streamsize n)
+{
+    _pos += n;
+    __atomic_store_n (&_c->tail, _pos, int(memory_order::release));
+}
+
+void Extern::ShmRing::read (const iovec* iov, unsigned n)
+{
+    for (auto i = 0u; i < n; ++i) {
+	copy_out (_pos, iov[i].iov_base, iov[i].iov_len);
+	_pos += iov[i].iov_len;
+    }
+    __atomic_store_n (&_c->tail, _pos, int(memory_order::release));
+}
+
+// Marks the consumer waiting for data on its doorbell, unless
+// data arrived in the meantime. Returns true when waiting.
+bool Extern::ShmRing::wait_for_data (void)
+{
+    __atomic_store_n (&_c->consumer_waiting, 1, int(memory_order::relaxed));
+    __atomic_thread_fence (int(memory_order::seq_cst));
+    if (!available())
+	return true;
+    __atomic_store_n (&_c->consumer_waiting, 0, int(memory_order::relaxed));
+    return false;
+}
+
+// The other side checks, after writing or reading the ring, whether
+// this side is waiting and must be woken. Only one wakes it.
+bool Extern::ShmRing::take_waiting (uint32_t& w) // static
+{
+    __atomic_thread_fence (int(memory_order::seq_cst));
+    return __atomic_load_n (&w, int(memory_order::relaxed))
+	&& __atomic_exchange_n (&w, 0, int(memory_order::acquire));
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ COMRelay
 
@@ -576,6 +1095,10 @@ bool COMRelay::on_error (mrid_t eid, const string& errmsg)
     return Msger::on_error (eid, errmsg);
 }
 
+// Local senders to the relay are pushed back by a slow socket
+bool COMRelay::is_backlogged (void) const
+    { return _pExtern && _pExtern->is_backlogged(); }
+
 void COMRelay::on_msger_destroyed (mrid_t id)
 {
     // When the Extern object is destroyed, this notification arrives from
@@ -610,6 +1133,11 @@ void COMRelay::COM_export (const string_view&)
     // Relays never receive this message
 }
 
+void COMRelay::COM_methods (const cmemlink&)
+{
+    // Relays never receive this message
+}
+
 void COMRelay::COM_delete (void)
 {
     // COM_delete indicates that the remote object has been destroyed.
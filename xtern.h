@@ -23,8 +23,10 @@ public:
     bool		dispatch (Msg& msg) override;
     bool		on_error (mrid_t eid, const string& errmsg) override;
     void		on_msger_destroyed (mrid_t id) override;
+    bool		is_backlogged (void) const override;
     inline void		COM_error (const string_view& errmsg);
     inline void		COM_export (const string_view& elist);
+    inline void		COM_methods (const cmemlink& mtable);
     void		COM_delete (void);
 private:
     Extern*	_pExtern;	// Outgoing connection object
@@ -39,10 +41,15 @@ class Extern : public Msger {
     IMPLEMENT_INTERFACES_I (Msger, (IExtern), (ITimer)(ICOM))
 public:
     using Info = IExtern::Info;
+    enum {
+	OutqLimit = 256,	// relays are backlogged with this many messages unwritten
+	InbufSize = 64*1024	// read from the socket at once; larger messages are read directly
+    };
 public:
     explicit		Extern (Msg::Link l);
 			~Extern (void) override;
     auto&		info (void) const	{ return _einfo; }
+    bool		is_backlogged (void) const override	{ return _outq.size() >= OutqLimit; }
     void		queue_outgoing (Msg&& msg, extid_t extid);
     void		queue_pending (Msg&& msg) { _pending.emplace_back (move(msg)); }
     extid_t		register_relay (COMRelay* relay);
@@ -51,6 +58,7 @@ public:
     void		Extern_close (void);
     inline void		COM_error (const string_view& errmsg);
     inline void		COM_export (string elist);
+    inline void		COM_methods (const cmemlink& mtable);
     inline void		COM_delete (void);
     void		Timer_timer (fd_t fd);
 private:
@@ -58,36 +66,83 @@ private:
     // Msg formatted for reading/writing to socket
     class ExtMsg {
     public:
+	// Once the other side sends its method table, messages not
+	// passing fds are indexed, with the method given by its index in
+	// the table instead of the header strings, and the fixed header
+	// is all there is of it.
 	struct alignas(8) Header {
-	    uint32_t	sz;		// Message body size, aligned to MsgAlignment
+	    // The first word is packed explicitly, from the low bit:
+	    // 24 bits of body size, 6 of nfds, a reserved 0, and indexed.
+	    enum : uint32_t {
+		SzBits = 24, SzMask = (1u<<SzBits)-1,
+		NfdsShift = SzBits, NfdsMask = 0x3f,
+		ReservedBit = 1u<<30, IndexedBit = 1u<<31
+	    };
+	    uint32_t	szbits;
 	    uint16_t	extid;		// Destination node mrid
-	    uint8_t	fdoffset;	// Offset to file descriptor in message body, if passing
-	    uint8_t	hsz;		// Full size of header
+	    union {
+		struct {
+		    uint8_t	fdoffset;	// Offset to file descriptors in message body, if passing
+		    uint8_t	hsz;		// Full size of header
+		};
+		uint16_t	mindex;		// Index of the method in the receiver's table, if indexed
+	    };
+	    // Message body size, aligned to Msg::Alignment::Body
+	    constexpr uint32_t	sz (void) const		{ return szbits & SzMask; }
+	    // Number of file descriptors in message body
+	    constexpr unsigned	nfds (void) const	{ return (szbits >> NfdsShift) & NfdsMask; }
+	    // The method is given by mindex, not by header strings
+	    constexpr bool	indexed (void) const	{ return szbits & IndexedBit; }
+	    static constexpr uint32_t pack (uint32_t sz, unsigned nfds, bool indexed)
+				    { return sz | nfds << NfdsShift | (indexed ? uint32_t(IndexedBit) : 0u); }
 	};
-	enum {
+	enum : uint32_t {
 	    MinHeaderSize = ceilg (sizeof(Header)+sizeof("i\0m\0"), Msg::Alignment::Header),
 	    MaxHeaderSize = UINT8_MAX-sizeof(Header),
-	    MaxBodySize = Msg::MaxSize
+	    MaxBodySize = Header::SzMask & ~(Msg::Alignment::Body-1),	// all aligned sizes that fit in sz
+	    MaxFds = Header::NfdsMask,	// all that fits in nfds
+	    MaxFdsPerSend = 253,	// SCM_MAX_FD, for all messages in one sendmsg
+	    NoMethodIndex = UINT16_MAX	// the method is not in the receiver's table
 	};
+	// Checks everything except whether the fds were passed
+	static constexpr bool	is_valid_header (const Header& h) {
+				    return (h.indexed() ? !h.nfds()
+					    : (h.hsz >= MinHeaderSize
+						&& divisible_by (h.hsz, Msg::Alignment::Header)
+						&& (h.fdoffset == Msg::NoFdIncluded ? !h.nfds()
+						    : (h.nfds() && h.fdoffset+h.nfds()*sizeof(fd_t) <= h.sz()
+							&& divisible_by (h.fdoffset, Msg::Alignment::Fd)))))
+					&& divisible_by (h.sz(), Msg::Alignment::Body)
+					&& !(h.szbits & Header::ReservedBit)
+					&& h.extid <= extid_ServerLast;
+				}
+	// Marker frames in the rings are empty fixed headers
+	static constexpr bool	is_marker (const Header& h)	{ return !h.indexed() && !h.hsz; }
+	static constexpr streamsize header_size (const Header& h) { return h.indexed() ? sizeof(h) : h.hsz; }
+	// The fds in the body are passed with the header
+	static constexpr unsigned fd_count (const Header& h)	{ return h.nfds(); }
     public:
 	constexpr		ExtMsg (void)		: _body(),_h{},_hbuf{}{}
-				ExtMsg (Msg&& msg, extid_t extid);
+				ExtMsg (Msg&& msg, extid_t extid, uint16_t mindex = NoMethodIndex);
 				ExtMsg (const ExtMsg&) = delete;
 				~ExtMsg (void)			{ _body.wipe(); }
 	void			operator= (const ExtMsg&) = delete;
 	constexpr auto&		header (void) const		{ return _h; }
 	constexpr auto		extid (void) const		{ return _h.extid; }
-	constexpr auto		fd_offset (void) const		{ return _h.fdoffset; }
-	constexpr streamsize	header_size (void) const	{ return _h.hsz; }
-	constexpr streamsize	body_size (void) const		{ return _h.sz; }
-	constexpr streamsize	size (void) const		{ return body_size() + header_size(); }
+	constexpr auto		fd_offset (void) const		{ return _h.indexed() ? Msg::NoFdIncluded : _h.fdoffset; }
+	constexpr streamsize	header_size (void) const	{ return header_size (_h); }
+	constexpr streamsize	body_size (void) const		{ return _h.sz(); }
+	constexpr streamsize	size (void) const		{ return header_size() + body_size(); }
 	constexpr bool		has_fd (void) const		{ return fd_offset() != Msg::NoFdIncluded; }
+	constexpr auto		fd_count (void) const		{ return fd_count (_h); }
 	constexpr void		set_header (const Header& h)	{ _h = h; }
 	void			allocate_body (streamsize sz)	{ _body.resize (sz); }
 	constexpr void		trim_body (streamsize sz)	{ _body.shrink (sz); }
 	constexpr auto&&	move_body (void)		{ return move(_body); }
-	constexpr void		set_passed_fd (fd_t fd)		{ assert (has_fd()); ostream(_body.iat(_h.fdoffset), sizeof(fd)) << fd; }
-	constexpr fd_t		passed_fd (void) const		{ return has_fd() ? istream(_body.iat(_h.fdoffset), sizeof(fd_t)).read<fd_t>() : -1; }
+	void			receive_fds (vector<fd_t>& fds);
+	void			write_passed_fds (ostream& os) const;
+	void			close_passed_fds (void) const;
+	constexpr fd_t		passed_fd (unsigned i = 0) const{ return i < _h.nfds() ? istream(_body.iat(_h.fdoffset+i*sizeof(fd_t)), sizeof(fd_t)).read<fd_t>() : -1; }
 	void			write_iovecs (iovec* iov, streamsize bw);
 	constexpr auto		read (void) const		{ return istream (_body.data(), _body.size()); }
 	methodid_t		parse_method (void);
@@ -102,6 +157,62 @@ private:
 	char			_hbuf [MaxHeaderSize];
     };
     //}}}2--------------------------------------------------------------
+    //{{{2 ShmRing -----------------------------------------------------
+    // Single producer, single consumer ring of ExtMsg frames in a memfd
+    // shared with the other side. Each side keeps its own position, so
+    // a misbehaving peer can only make it read garbage frames, which
+    // then fail validation, and never outside the mapping.
+    class ShmRing {
+    public:
+	enum : uint32_t { DefaultSize = 256*1024, MinSize = 4096 };
+	struct Control {
+	    alignas(64) uint64_t	head;		// bytes written by the producer
+	    uint32_t		consumer_waiting;	// on its doorbell, for data
+	    alignas(64) uint64_t	tail;		// bytes read by the consumer
+	    uint32_t		producer_waiting;	// on its doorbell, for space
+	};
+    public:
+	constexpr		ShmRing (void)		: _c(),_data(),_pos(),_mask() {}
+				~ShmRing (void)		{ close(); }
+				ShmRing (const ShmRing&) = delete;
+	void			operator= (const ShmRing&) = delete;
+	constexpr bool		is_open (void) const	{ return _c; }
+	constexpr streamsize	capacity (void) const	{ return _mask+1; }
+	fd_t			create (streamsize sz = DefaultSize);
+	bool			attach (fd_t fd);
+	void			close (void);
+	streamsize		space (void) const;
+	bool			write (const iovec* iov, unsigned n);
+	streamsize		available (void) const;
+	void			peek (void* p, streamsize n) const;
+	void			read (const iovec* iov, unsigned n);
+	void			skip (streamsize n);
+	bool			wait_for_data (void);
+	bool			wait_for_space (streamsize n);
+	bool			take_waiting_consumer (void)	{ return take_waiting (_c->consumer_waiting); }
+	bool			take_waiting_producer (void)	{ return take_waiting (_c->producer_waiting); }
+    private:
+	bool			map (fd_t fd, streamsize sz);
+	static bool		take_waiting (uint32_t& w);
+	void			copy_out (uint64_t pos, void* p, streamsize n) const;
+    private:
+	Control*		_c;
+	char*			_data;
+	uint64_t		_pos;	// head for the producer, tail for the consumer
+	uint64_t		_mask;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 MethodIndex
+    // The other side's method table, as index of each local method,
+    // sorted by method for lookup when queueing messages.
+    struct MethodIndex {
+	methodid_t	method;
+	uint16_t	index;
+    public:
+	constexpr bool operator< (const MethodIndex& v) const
+	    { return uintptr_t(method) < uintptr_t(v.method); }
+    };
+    //}}}2--------------------------------------------------------------
     //{{{2 PRelay
     struct PRelay {
 	COMRelay*	pRelay;
@@ -123,10 +234,21 @@ private:
 			    { return id + ((_einfo.side == IExtern::SocketSide::Client) ? extid_ClientBase : extid_ServerBase); }
     PRelay*		prelay_by_extid (extid_t extid);
     PRelay*		prelay_by_id (mrid_t id);
+    memblock		create_method_table (void);
+    uint16_t		method_index (methodid_t mid) const;
+    constexpr methodid_t method_by_index (uint16_t mi) const
+			    { return mi < _inmethods.size() ? _inmethods[mi] : nullptr; }
     void		requeue_pending (void);
     bool		write_outgoing (void);
     void		read_incoming (void);
-    inline bool		accept_incoming_message (void);
+    bool		finish_incoming_message (void);
+    bool		accept_incoming_message (ExtMsg& m);
+    constexpr bool	is_reading_ring (void) const	{ return _peerbell >= 0; }
+    void		open_rings (void);
+    bool		accept_ring_setup (methodid_t method, ExtMsg& m);
+    bool		write_ring (void);
+    bool		read_ring (bool tomarker = false);
+    void		ring_doorbell (void);
 private:
     fd_t		_sockfd;
     ITimer		_timer;
@@ -135,9 +257,21 @@ private:
     vector<PRelay>	_relays;
     AppL::msgq_t	_pending;	// messages that created this connection
     Info		_einfo;
-    streamsize		_bread;
-    ExtMsg		_inmsg;		// currently incoming message
-    fd_t		_infd;
+    streamsize		_bread;		// of _inmsg, when read directly
+    ExtMsg		_inmsg;		// currently incoming large message
+    vector<fd_t>	_infds;		// received, for messages not yet read
+    uint32_t		_noldfds;	// in _infds, received before the last passed batch
+    vector<methodid_t>	_inmethods;	// method table sent to the other side, by index
+    vector<MethodIndex>	_outmethods;	// method table received from the other side
+    memblock		_inbuf;		// received data, for messages not yet accepted
+    streamsize		_inpos;		// of the first unread message in _inbuf
+    ITimer		_ringtimer;	// watches _doorbell
+    ShmRing		_rout;		// written by this side
+    ShmRing		_rin;		// written by the other side
+    fd_t		_doorbell;	// eventfd this side waits on
+    fd_t		_peerbell;	// eventfd the other side waits on
+    uint32_t		_nplain;	// messages at the front of _outq to write to the socket as they are
+    uint32_t		_nfdspassed;	// messages at the front of _outq whose fds were passed
 };
 
 } // namespace cwiclo